@@ -0,0 +1,207 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Shell commands to inspect and tune the ipflow meter
+ */
+
+#include "contiki.h"
+#include "shell.h"
+#include "net/ipv6/ipv6flow/ipflow.h"
+#include "net/ipv6/ipv6flow/ipflow-aggregate.h"
+
+#include <stdio.h>
+
+#define BUFLEN 64
+
+/*---------------------------------------------------------------------------*/
+PROCESS(shell_ipflow_flows_process, "ipflow-flows");
+SHELL_COMMAND(ipflow_flows_command,
+	      "ipflow-flows",
+	      "ipflow-flows: dump the flow table",
+	      &shell_ipflow_flows_process);
+PROCESS(shell_ipflow_stats_process, "ipflow-stats");
+SHELL_COMMAND(ipflow_stats_command,
+	      "ipflow-stats",
+	      "ipflow-stats: show meter statistics",
+	      &shell_ipflow_stats_process);
+PROCESS(shell_ipflow_sample_process, "ipflow-sample");
+SHELL_COMMAND(ipflow_sample_command,
+	      "ipflow-sample",
+	      "ipflow-sample [rate]: show or set packet sampling, 1 out of <rate>",
+	      &shell_ipflow_sample_process);
+PROCESS(shell_ipflow_interval_process, "ipflow-interval");
+SHELL_COMMAND(ipflow_interval_command,
+	      "ipflow-interval",
+	      "ipflow-interval [minutes]: show or set the export interval",
+	      &shell_ipflow_interval_process);
+PROCESS(shell_ipflow_export_process, "ipflow-export");
+SHELL_COMMAND(ipflow_export_command,
+	      "ipflow-export",
+	      "ipflow-export: export the flow table now",
+	      &shell_ipflow_export_process);
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_ipflow_flows_process, ev, data)
+{
+  char buf[BUFLEN];
+  flow_t *flow;
+
+  PROCESS_BEGIN();
+
+  if(get_process_status() != 1) {
+    shell_output_str(&ipflow_flows_command, "ipflow is not running", "");
+    PROCESS_EXIT();
+  }
+
+  for(flow = get_flow_table_head(); flow != NULL; flow = flow->next) {
+    /* Two lines per flow, all counters would not fit BUFLEN */
+    snprintf(buf, BUFLEN, "%04x:%04x %u octets, %u packets",
+	     uip_ntohs(flow->destination.u16[6]),
+	     uip_ntohs(flow->destination.u16[7]),
+	     flow->size, flow->packets);
+    shell_output_str(&ipflow_flows_command, "", buf);
+    snprintf(buf, BUFLEN, "%u on air, %u frags, %u rtx, %u drops",
+	     flow->onair_size, flow->fragments,
+	     flow->retransmissions, flow->drops);
+    shell_output_str(&ipflow_flows_command, "  ", buf);
+  }
+  snprintf(buf, BUFLEN, "%d/%d", get_number_flows(), MAX_FLOWS);
+  shell_output_str(&ipflow_flows_command, "Flows: ", buf);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_ipflow_stats_process, ev, data)
+{
+  char buf[BUFLEN];
+  const ipflow_stats_t *stats;
+
+  PROCESS_BEGIN();
+
+  stats = get_ipflow_stats();
+
+  snprintf(buf, BUFLEN, "%d now, %u max, %u evicted, %u overflows",
+	   get_number_flows(), stats->max_flows, stats->evictions,
+	   stats->overflows);
+  shell_output_str(&ipflow_stats_command, "Flows: ", buf);
+
+  snprintf(buf, BUFLEN, "%lu seen, %lu accounted",
+	   (unsigned long)stats->packets_seen,
+	   (unsigned long)stats->packets_accounted);
+  shell_output_str(&ipflow_stats_command, "Packets: ", buf);
+
+  snprintf(buf, BUFLEN, "%lu lookups, %lu.%02lu entries compared on average",
+	   (unsigned long)stats->lookups,
+	   (unsigned long)(stats->lookups == 0 ? 0 :
+			   stats->lookup_steps / stats->lookups),
+	   (unsigned long)(stats->lookups == 0 ? 0 :
+			   (stats->lookup_steps * 100 / stats->lookups) % 100));
+  shell_output_str(&ipflow_stats_command, "Lookups: ", buf);
+
+#if IPFLOW_AGGREGATE_LEVELS
+  snprintf(buf, BUFLEN, "%u overflows", stats->aggregate_overflows);
+  shell_output_str(&ipflow_stats_command, "Aggregates: ", buf);
+#endif /* IPFLOW_AGGREGATE_LEVELS */
+
+  snprintf(buf, BUFLEN, "%lu messages, %lu octets",
+	   (unsigned long)stats->messages, (unsigned long)stats->octets);
+  shell_output_str(&ipflow_stats_command, "Exports: ", buf);
+  snprintf(buf, BUFLEN, "%u largest, %u dropped",
+	   stats->max_message, stats->dropped_sends);
+  shell_output_str(&ipflow_stats_command, "  ", buf);
+
+  snprintf(buf, BUFLEN, "%u rtimer ticks longest",
+	   (unsigned)stats->encode_ticks);
+  shell_output_str(&ipflow_stats_command, "Encoding: ", buf);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_ipflow_sample_process, ev, data)
+{
+  char buf[10];
+  const char *nextptr;
+  int rate;
+
+  PROCESS_BEGIN();
+
+  rate = shell_strtolong(data, &nextptr);
+  if(nextptr != data) {
+    set_sampling_rate(rate);
+  }
+  snprintf(buf, sizeof(buf), "%d", get_sampling_rate());
+  shell_output_str(&ipflow_sample_command, "Sampling 1 out of ", buf);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_ipflow_interval_process, ev, data)
+{
+  char buf[21];
+  const char *nextptr;
+  int minutes;
+
+  PROCESS_BEGIN();
+
+  minutes = shell_strtolong(data, &nextptr);
+  if(nextptr != data && !set_export_interval(minutes)) {
+    snprintf(buf, sizeof(buf), "%lu", (unsigned long)IPFLOW_MAX_EXPORT_INTERVAL);
+    shell_output_str(&ipflow_interval_command,
+		     "Interval must be between 1 and ", buf);
+  }
+  snprintf(buf, sizeof(buf), "%d", get_export_interval());
+  shell_output_str(&ipflow_interval_command, "Export interval (minutes): ", buf);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_ipflow_export_process, ev, data)
+{
+  char buf[10];
+
+  PROCESS_BEGIN();
+
+  snprintf(buf, sizeof(buf), "%d", get_number_exported_flows());
+  export_now();
+  shell_output_str(&ipflow_export_command, "Exported flows: ", buf);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+shell_ipflow_init(void)
+{
+  shell_register_command(&ipflow_flows_command);
+  shell_register_command(&ipflow_stats_command);
+  shell_register_command(&ipflow_sample_command);
+  shell_register_command(&ipflow_interval_command);
+  shell_register_command(&ipflow_export_command);
+}
+/*---------------------------------------------------------------------------*/
@@ -380,6 +380,7 @@ struct shell_input {
 #include "shell-exec.h"
 #include "shell-file.h"
 #include "shell-httpd.h"
+#include "shell-ipflow.h"
 #include "shell-irc.h"
 #include "shell-memdebug.h"
 #include "shell-netperf.h"
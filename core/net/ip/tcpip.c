@@ -536,10 +536,96 @@ tcpip_input(void)
 }
 /*---------------------------------------------------------------------------*/
 #if NETSTACK_CONF_WITH_IPV6
+#if TCPIP_NEXTHOP_CACHE
+#if !UIP_DS6_NOTIFICATIONS
+#error TCPIP_CONF_NEXTHOP_CACHE needs UIP_DS6_NOTIFICATIONS to learn about route changes
+#endif
+
+static struct nexthop_cache_entry {
+  uip_ipaddr_t destipaddr;
+  uip_ds6_nbr_t *nbr;
+  /* Route the neighbor was resolved with, NULL for on-link and default
+     route destinations. Valid until the next route change. */
+  uip_ds6_route_t *route;
+} nexthop_cache[TCPIP_NEXTHOP_CACHE];
+/* Entry to replace next, the cache is filled round-robin */
+static uint8_t nexthop_cache_next;
+static struct uip_ds6_notification nexthop_cache_notification;
+/*---------------------------------------------------------------------------*/
+void
+tcpip_nexthop_cache_flush(void)
+{
+  uint8_t i;
+
+  for(i = 0; i < TCPIP_NEXTHOP_CACHE; i++) {
+    nexthop_cache[i].nbr = NULL;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+nexthop_cache_route_changed(int event, uip_ipaddr_t *route,
+                            uip_ipaddr_t *nexthop, int num_routes)
+{
+  /* A new route may be more specific than the one an entry was
+     resolved with, so any change invalidates the whole cache */
+  tcpip_nexthop_cache_flush();
+}
+/*---------------------------------------------------------------------------*/
+/* Get the cached next-hop neighbor of a destination, if it is resolved,
+   and the route it was resolved with */
+static uip_ds6_nbr_t *
+nexthop_cache_lookup(uip_ipaddr_t *destipaddr, uip_ds6_route_t **route)
+{
+  uint8_t i;
+
+  for(i = 0; i < TCPIP_NEXTHOP_CACHE; i++) {
+    if(nexthop_cache[i].nbr != NULL &&
+       uip_ipaddr_cmp(&nexthop_cache[i].destipaddr, destipaddr)) {
+      if(nexthop_cache[i].nbr->state == NBR_INCOMPLETE) {
+        return NULL;
+      }
+      *route = nexthop_cache[i].route;
+      if(*route != NULL) {
+        /* The route is in use even though it was not looked up */
+        uip_ds6_route_touch(*route);
+      }
+      return nexthop_cache[i].nbr;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+nexthop_cache_add(uip_ipaddr_t *destipaddr, uip_ds6_nbr_t *nbr,
+                  uip_ds6_route_t *route)
+{
+  uint8_t i;
+
+  for(i = 0; i < TCPIP_NEXTHOP_CACHE; i++) {
+    if(nexthop_cache[i].nbr != NULL &&
+       uip_ipaddr_cmp(&nexthop_cache[i].destipaddr, destipaddr)) {
+      nexthop_cache[i].nbr = nbr;
+      nexthop_cache[i].route = route;
+      return;
+    }
+  }
+  uip_ipaddr_copy(&nexthop_cache[nexthop_cache_next].destipaddr, destipaddr);
+  nexthop_cache[nexthop_cache_next].nbr = nbr;
+  nexthop_cache[nexthop_cache_next].route = route;
+  nexthop_cache_next = (nexthop_cache_next + 1) % TCPIP_NEXTHOP_CACHE;
+}
+#else /* TCPIP_NEXTHOP_CACHE */
+void
+tcpip_nexthop_cache_flush(void)
+{
+}
+#endif /* TCPIP_NEXTHOP_CACHE */
+/*---------------------------------------------------------------------------*/
 void
 tcpip_ipv6_output(void)
 {
   uip_ds6_nbr_t *nbr = NULL;
+  uip_ds6_route_t *route = NULL;
   uip_ipaddr_t *nexthop;
 
   if(uip_len == 0) {
@@ -562,13 +648,19 @@ tcpip_ipv6_output(void)
     /* Next hop determination */
     nbr = NULL;
 
+#if TCPIP_NEXTHOP_CACHE
+    /* A steady flow finds its next-hop neighbor already resolved. */
+    nbr = nexthop_cache_lookup(&UIP_IP_BUF->destipaddr, &route);
+    if(nbr != NULL) {
+      nexthop = &nbr->ipaddr;
+    } else
+#endif /* TCPIP_NEXTHOP_CACHE */
     /* We first check if the destination address is on our immediate
        link. If so, we simply use the destination address as our
        nexthop address. */
     if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)){
       nexthop = &UIP_IP_BUF->destipaddr;
     } else {
-      uip_ds6_route_t *route;
       /* Check if we have a route to the destination address. */
       route = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr);
 
@@ -647,7 +739,9 @@ tcpip_ipv6_output(void)
       return;
     }
 #endif /* UIP_CONF_IPV6_RPL */
-    nbr = uip_ds6_nbr_lookup(nexthop);
+    if(nbr == NULL) {
+      nbr = uip_ds6_nbr_lookup(nexthop);
+    }
     if(nbr == NULL) {
 #if UIP_ND6_SEND_NA
       if((nbr = uip_ds6_nbr_add(nexthop, NULL, 0, NBR_INCOMPLETE)) == NULL) {
@@ -656,10 +750,8 @@ tcpip_ipv6_output(void)
       } else {
 #if UIP_CONF_IPV6_QUEUE_PKT
         /* Copy outgoing pkt in the queuing buffer for later transmit. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
-        }
+        uip_packetqueue_enqueue(&nbr->packethandle, UIP_IP_BUF, uip_len,
+                                UIP_DS6_NBR_PACKET_LIFETIME);
 #endif
       /* RFC4861, 7.2.2:
        * "If the source address of the packet prompting the solicitation is the
@@ -684,10 +776,8 @@ tcpip_ipv6_output(void)
 #if UIP_CONF_IPV6_QUEUE_PKT
         /* Copy outgoing pkt in the queuing buffer for later transmit and set
            the destination nbr to nbr. */
-        if(uip_packetqueue_alloc(&nbr->packethandle, UIP_DS6_NBR_PACKET_LIFETIME) != NULL) {
-          memcpy(uip_packetqueue_buf(&nbr->packethandle), UIP_IP_BUF, uip_len);
-          uip_packetqueue_set_buflen(&nbr->packethandle, uip_len);
-        }
+        uip_packetqueue_enqueue(&nbr->packethandle, UIP_IP_BUF, uip_len,
+                                UIP_DS6_NBR_PACKET_LIFETIME);
 #endif /*UIP_CONF_IPV6_QUEUE_PKT*/
         uip_len = 0;
         return;
@@ -702,6 +792,9 @@ tcpip_ipv6_output(void)
       }
 #endif /* UIP_ND6_SEND_NA */
 
+#if TCPIP_NEXTHOP_CACHE
+      nexthop_cache_add(&UIP_IP_BUF->destipaddr, nbr, route);
+#endif /* TCPIP_NEXTHOP_CACHE */
       tcpip_output(uip_ds6_nbr_get_ll(nbr));
 
 #if UIP_CONF_IPV6_QUEUE_PKT
@@ -709,12 +802,11 @@ tcpip_ipv6_output(void)
        * Send the queued packets from here, may not be 100% perfect though.
        * This happens in a few cases, for example when instead of receiving a
        * NA after sendiong a NS, you receive a NS with SLLAO: the entry moves
-       * to STALE, and you must both send a NA and the queued packet.
+       * to STALE, and you must both send a NA and the queued packets.
+       * They go out in the order they were queued.
        */
-      if(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
-        uip_len = uip_packetqueue_buflen(&nbr->packethandle);
-        memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-        uip_packetqueue_free(&nbr->packethandle);
+      while(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
+        uip_len = uip_packetqueue_dequeue(&nbr->packethandle, UIP_IP_BUF);
         tcpip_output(uip_ds6_nbr_get_ll(nbr));
       }
 #endif /*UIP_CONF_IPV6_QUEUE_PKT*/
@@ -817,6 +909,10 @@ PROCESS_THREAD(tcpip_process, ev, data)
 #ifdef UIP_FALLBACK_INTERFACE
   UIP_FALLBACK_INTERFACE.init();
 #endif
+#if NETSTACK_CONF_WITH_IPV6 && TCPIP_NEXTHOP_CACHE
+  uip_ds6_notification_add(&nexthop_cache_notification,
+                           nexthop_cache_route_changed);
+#endif /* TCPIP_NEXTHOP_CACHE */
 /* initialize RPL if configured for using RPL */
 #if NETSTACK_CONF_WITH_IPV6 && UIP_CONF_IPV6_RPL
   rpl_init();
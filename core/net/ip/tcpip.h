@@ -353,6 +353,23 @@ void tcpip_set_outputfunc(uint8_t (* f)(void));
  */
 #if NETSTACK_CONF_WITH_IPV6
 void tcpip_ipv6_output(void);
+
+/**
+ * \brief Number of destinations for which tcpip_ipv6_output() remembers
+ * the next-hop neighbor, so that steady flows skip the on-link check,
+ * the route lookup and the neighbor lookup. 0 disables the cache.
+ */
+#ifdef TCPIP_CONF_NEXTHOP_CACHE
+#define TCPIP_NEXTHOP_CACHE TCPIP_CONF_NEXTHOP_CACHE
+#else
+#define TCPIP_NEXTHOP_CACHE 0
+#endif
+
+/**
+ * \brief Forget all cached next hops. Called when routes, prefixes or
+ * neighbors change.
+ */
+void tcpip_nexthop_cache_flush(void);
 #endif
 
 /**
@@ -0,0 +1,250 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \addtogroup uip
+ * @{
+ */
+
+/**
+ * \file
+ *    Internet checksum computation and incremental update.
+ *
+ *    The one's complement sum is independent of byte order (RFC 1071,
+ *    section 2), so the wide paths add words in native byte order and
+ *    swap the folded result once, instead of assembling every 16-bit
+ *    word from two bytes.
+ */
+
+#include "net/ip/uip.h"
+#include "net/ip/uip-chksum.h"
+
+#include <string.h>
+
+#if UIP_CHKSUM_SIMD
+#ifdef __AVX2__
+#include <immintrin.h>
+#define SIMD_BLOCK 32
+#else
+#include <emmintrin.h>
+#define SIMD_BLOCK 16
+#endif
+/* Below this length the setup and the horizontal add do not pay off */
+#define SIMD_MIN_LEN 64
+#endif /* UIP_CHKSUM_SIMD */
+
+#if UIP_CHKSUM_ACC_BITS == 64 || UIP_CHKSUM_SIMD
+typedef uint64_t acc_t;
+#else
+typedef uint32_t acc_t;
+#endif
+
+/*---------------------------------------------------------------------------*/
+static uint16_t
+fold32(uint32_t acc)
+{
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc += acc >> 16;
+  return (uint16_t)acc;
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_CHKSUM_ACC_BITS != 16 || UIP_CHKSUM_SIMD
+static uint16_t
+fold(acc_t acc)
+{
+#if UIP_CHKSUM_ACC_BITS == 64 || UIP_CHKSUM_SIMD
+  acc = (acc >> 32) + (acc & 0xffffffff);
+  acc = (acc >> 32) + (acc & 0xffffffff);
+#endif
+  return fold32((uint32_t)acc);
+}
+#endif /* UIP_CHKSUM_ACC_BITS != 16 || UIP_CHKSUM_SIMD */
+/*---------------------------------------------------------------------------*/
+#if UIP_CHKSUM_SIMD
+/* Sums the 16-bit words of len bytes, len being a multiple of
+   SIMD_BLOCK. Every 16-bit lane is zero-extended into a 32-bit lane,
+   which cannot overflow for a 16-bit length. */
+static acc_t
+simd_sum(const uint8_t *data, uint16_t len)
+{
+  uint32_t lanes[SIMD_BLOCK / 4];
+  acc_t acc;
+  int i;
+#ifdef __AVX2__
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i v, sum;
+
+  sum = zero;
+  for(; len > 0; len -= SIMD_BLOCK, data += SIMD_BLOCK) {
+    v = _mm256_loadu_si256((const __m256i *)data);
+    sum = _mm256_add_epi32(sum, _mm256_unpacklo_epi16(v, zero));
+    sum = _mm256_add_epi32(sum, _mm256_unpackhi_epi16(v, zero));
+  }
+  _mm256_storeu_si256((__m256i *)lanes, sum);
+#else /* __AVX2__ */
+  const __m128i zero = _mm_setzero_si128();
+  __m128i v, sum;
+
+  sum = zero;
+  for(; len > 0; len -= SIMD_BLOCK, data += SIMD_BLOCK) {
+    v = _mm_loadu_si128((const __m128i *)data);
+    sum = _mm_add_epi32(sum, _mm_unpacklo_epi16(v, zero));
+    sum = _mm_add_epi32(sum, _mm_unpackhi_epi16(v, zero));
+  }
+  _mm_storeu_si128((__m128i *)lanes, sum);
+#endif /* __AVX2__ */
+
+  acc = 0;
+  for(i = 0; i < SIMD_BLOCK / 4; i++) {
+    acc += lanes[i];
+  }
+  return acc;
+}
+#endif /* UIP_CHKSUM_SIMD */
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+#if UIP_CHKSUM_ACC_BITS == 16 && !UIP_CHKSUM_SIMD
+  uint16_t t;
+  const uint8_t *dataptr;
+  const uint8_t *last_byte;
+
+  dataptr = data;
+  last_byte = data + len - 1;
+
+  while(dataptr < last_byte) {   /* At least two more bytes */
+    t = (dataptr[0] << 8) + dataptr[1];
+    sum += t;
+    if(sum < t) {
+      sum++;      /* carry */
+    }
+    dataptr += 2;
+  }
+
+  if(dataptr == last_byte) {
+    t = (dataptr[0] << 8) + 0;
+    sum += t;
+    if(sum < t) {
+      sum++;      /* carry */
+    }
+  }
+
+  /* Return sum in host byte order. */
+  return sum;
+#else /* UIP_CHKSUM_ACC_BITS == 16 && !UIP_CHKSUM_SIMD */
+  acc_t acc;
+  uint16_t w16;
+  uint8_t tail[2];
+#if UIP_CHKSUM_ACC_BITS == 64
+  uint32_t w32;
+#endif
+
+  /* Work in the byte order of the data, i.e. in network byte order
+     as seen by a native load. */
+  acc = uip_htons(sum);
+
+#if UIP_CHKSUM_SIMD
+  if(len >= SIMD_MIN_LEN) {
+    uint16_t simd_len = len - (len % SIMD_BLOCK);
+    acc += simd_sum(data, simd_len);
+    data += simd_len;
+    len -= simd_len;
+  }
+#endif /* UIP_CHKSUM_SIMD */
+
+#if UIP_CHKSUM_ACC_BITS == 64
+  while(len >= 4) {
+    memcpy(&w32, data, 4);
+    acc += w32;
+    data += 4;
+    len -= 4;
+  }
+#endif /* UIP_CHKSUM_ACC_BITS == 64 */
+
+  while(len >= 2) {
+    memcpy(&w16, data, 2);
+    acc += w16;
+    data += 2;
+    len -= 2;
+  }
+
+  if(len > 0) {
+    /* Pad the odd byte with zero at the higher address. */
+    tail[0] = *data;
+    tail[1] = 0;
+    memcpy(&w16, tail, 2);
+    acc += w16;
+  }
+
+  /* Return sum in host byte order. */
+  return uip_ntohs(fold(acc));
+#endif /* UIP_CHKSUM_ACC_BITS == 16 && !UIP_CHKSUM_SIMD */
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_update16(uint16_t chksum, uint16_t old_val, uint16_t new_val)
+{
+  /* HC' = ~(~HC + ~m + m') */
+  return ~fold32((uint32_t)(uint16_t)~chksum +
+                 (uint16_t)~old_val + new_val);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_update32(uint16_t chksum, uint32_t old_val, uint32_t new_val)
+{
+  uint32_t acc;
+
+  acc = (uint16_t)~chksum;
+  acc += (uint16_t)~(old_val >> 16);
+  acc += (uint16_t)~(old_val & 0xffff);
+  acc += new_val >> 16;
+  acc += new_val & 0xffff;
+  return ~fold32(acc);
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_replace(uint16_t chksum,
+                   const uint8_t *old_data, uint16_t old_len,
+                   const uint8_t *new_data, uint16_t new_len)
+{
+  uint32_t acc;
+
+  acc = (uint16_t)~uip_ntohs(chksum);
+  acc += (uint16_t)~uip_chksum_add(0, old_data, old_len);
+  acc += uip_chksum_add(0, new_data, new_len);
+  return uip_htons((uint16_t)~fold32(acc));
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_update(uint16_t chksum, const uint8_t *old_data,
+                  const uint8_t *new_data, uint16_t len)
+{
+  return uip_chksum_replace(chksum, old_data, len, new_data, len);
+}
+/*---------------------------------------------------------------------------*/
+/** @} */
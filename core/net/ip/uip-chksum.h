@@ -0,0 +1,142 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \addtogroup uip
+ * @{
+ */
+
+/**
+ * \file
+ *    Internet checksum (RFC 1071) shared by the IPv4, IPv6 and IP64
+ *    code, with word-at-a-time accumulation, an optional SSE2/AVX2
+ *    path on the native platform, and RFC 1624 incremental updates
+ *    for header rewrites.
+ */
+
+#ifndef UIP_CHKSUM_H_
+#define UIP_CHKSUM_H_
+
+#include "contiki-conf.h"
+#include <stdint.h>
+
+/**
+ * Width of the accumulator used by uip_chksum_add(): 16 is the
+ * classic byte-pair loop with an end-around carry per word, 32 adds
+ * 16-bit words into a 32-bit accumulator and 64 adds 32-bit words
+ * into a 64-bit accumulator, folding the carries once at the end.
+ * The default follows the native pointer width, so 8- and 16-bit
+ * MCUs keep the original loop.
+ */
+#ifdef UIP_CHKSUM_CONF_ACC_BITS
+#define UIP_CHKSUM_ACC_BITS UIP_CHKSUM_CONF_ACC_BITS
+#elif defined(__SIZEOF_POINTER__) && __SIZEOF_POINTER__ >= 8
+#define UIP_CHKSUM_ACC_BITS 64
+#elif defined(__SIZEOF_POINTER__) && __SIZEOF_POINTER__ >= 4
+#define UIP_CHKSUM_ACC_BITS 32
+#else
+#define UIP_CHKSUM_ACC_BITS 16
+#endif
+
+/**
+ * Use SSE2 (or AVX2, when the compiler targets it) for long buffers
+ * on the native platform.
+ */
+#ifdef UIP_CHKSUM_CONF_SIMD
+#define UIP_CHKSUM_SIMD UIP_CHKSUM_CONF_SIMD
+#elif defined(CONTIKI_TARGET_NATIVE) && defined(__SSE2__)
+#define UIP_CHKSUM_SIMD 1
+#else
+#define UIP_CHKSUM_SIMD 0
+#endif
+
+/**
+ * \brief Add a buffer to a running checksum
+ * \param sum The running 16-bit one's complement sum, in host byte order
+ * \param data The data, in network byte order. No alignment is required.
+ * \param len The number of bytes; an odd trailing byte is padded with zero
+ * \return The new running sum, in host byte order
+ *
+ * The result is not complemented, so it can be fed into further
+ * calls (pseudo-header, then payload) before the caller complements it.
+ */
+uint16_t uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len);
+
+/**
+ * \brief Update a checksum after a 16-bit field changed (RFC 1624, eqn. 3)
+ * \param chksum The checksum as stored in the header
+ * \param old_val The old field value, as stored in the header
+ * \param new_val The new field value, as stored in the header
+ * \return The checksum to store in the header
+ *
+ * The one's complement sum is byte-order independent, so all three
+ * values may simply be read from and written to the packet without
+ * byte swapping.
+ */
+uint16_t uip_chksum_update16(uint16_t chksum, uint16_t old_val,
+                             uint16_t new_val);
+
+/**
+ * \brief Update a checksum after a 32-bit field changed
+ *
+ * Same as uip_chksum_update16(), for a 32-bit field such as an IPv4
+ * address read from the packet in one access.
+ */
+uint16_t uip_chksum_update32(uint16_t chksum, uint32_t old_val,
+                             uint32_t new_val);
+
+/**
+ * \brief Update a checksum after a run of bytes changed
+ * \param chksum The checksum as stored in the header
+ * \param old_data The old contents of the field
+ * \param new_data The new contents of the field
+ * \param len The length of the field, which must start at an even offset
+ *        from the start of the checksummed data
+ * \return The checksum to store in the header
+ */
+uint16_t uip_chksum_update(uint16_t chksum, const uint8_t *old_data,
+                           const uint8_t *new_data, uint16_t len);
+
+/**
+ * \brief Update a checksum after a field was replaced by one of
+ *        another length
+ * \param chksum The checksum as stored in the header
+ * \param old_data The contents that were removed from the checksum
+ * \param old_len The length of old_data
+ * \param new_data The contents that were added to the checksum
+ * \param new_len The length of new_data
+ * \return The checksum to store in the header
+ *
+ * Used when a header is translated rather than patched, e.g. when an
+ * IPv6 address pair in a pseudo-header is replaced by an IPv4 pair.
+ */
+uint16_t uip_chksum_replace(uint16_t chksum,
+                            const uint8_t *old_data, uint16_t old_len,
+                            const uint8_t *new_data, uint16_t new_len);
+
+#endif /* UIP_CHKSUM_H_ */
+/** @} */
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "net/ip/uip.h"
 
@@ -6,8 +7,9 @@
 
 #include "net/ip/uip-packetqueue.h"
 
-#define MAX_NUM_QUEUED_PACKETS 2
-MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
+MEMB(packets_memb, struct uip_packetqueue_packet, UIP_PACKETQUEUE_NUM);
+
+static struct uip_packetqueue_stats stats;
 
 #define DEBUG 0
 #if DEBUG
@@ -17,15 +19,31 @@ MEMB(packets_memb, struct uip_packetqueue_packet, MAX_NUM_QUEUED_PACKETS);
 #define PRINTF(...)
 #endif
 
+/*---------------------------------------------------------------------------*/
+static void
+packet_remove(struct uip_packetqueue_packet *p)
+{
+  struct uip_packetqueue_packet **link;
+
+  for(link = &p->handle->packet; *link != NULL; link = &(*link)->next) {
+    if(*link == p) {
+      *link = p->next;
+      p->handle->len--;
+      break;
+    }
+  }
+  ctimer_stop(&p->lifetimer);
+  memb_free(&packets_memb, p);
+}
 /*---------------------------------------------------------------------------*/
 static void
 packet_timedout(void *ptr)
 {
-  struct uip_packetqueue_handle *h = ptr;
+  struct uip_packetqueue_packet *p = ptr;
 
-  PRINTF("uip_packetqueue_free timed out %p\n", h);
-  memb_free(&packets_memb, h->packet);
-  h->packet = NULL;
+  PRINTF("uip_packetqueue_free timed out %p\n", p->handle);
+  stats.expired++;
+  packet_remove(p);
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -33,54 +51,77 @@ uip_packetqueue_new(struct uip_packetqueue_handle *handle)
 {
   PRINTF("uip_packetqueue_new %p\n", handle);
   handle->packet = NULL;
+  handle->len = 0;
 }
 /*---------------------------------------------------------------------------*/
-struct uip_packetqueue_packet *
-uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime)
+int
+uip_packetqueue_enqueue(struct uip_packetqueue_handle *handle,
+                        const void *buf, uint16_t len, clock_time_t lifetime)
 {
-  PRINTF("uip_packetqueue_alloc %p\n", handle);
-  if(handle->packet != NULL) {
-    PRINTF("alloced\n");
-    return NULL;
+  struct uip_packetqueue_packet *p;
+  struct uip_packetqueue_packet **link;
+
+  PRINTF("uip_packetqueue_enqueue %p\n", handle);
+  if(handle->len >= UIP_PACKETQUEUE_MAX_PER_HANDLE) {
+    PRINTF("queue full\n");
+    stats.dropped_limit++;
+    return 0;
+  }
+  if(len > sizeof(p->queue_buf)) {
+    return 0;
   }
-  handle->packet = memb_alloc(&packets_memb);
-  if(handle->packet != NULL) {
-    ctimer_set(&handle->packet->lifetimer, lifetime,
-               packet_timedout, handle);
-  } else {
-    PRINTF("uip_packetqueue_alloc failed\n");
+  p = memb_alloc(&packets_memb);
+  if(p == NULL) {
+    PRINTF("uip_packetqueue_enqueue failed\n");
+    stats.dropped_pool++;
+    return 0;
+  }
+
+  memcpy(p->queue_buf, buf, len);
+  p->queue_buf_len = len;
+  p->handle = handle;
+  p->next = NULL;
+  ctimer_set(&p->lifetimer, lifetime, packet_timedout, p);
+
+  for(link = &handle->packet; *link != NULL; link = &(*link)->next);
+  *link = p;
+  handle->len++;
+  stats.queued++;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_packetqueue_dequeue(struct uip_packetqueue_handle *handle, void *buf)
+{
+  uint16_t len;
+
+  if(handle->packet == NULL) {
+    return 0;
   }
-  return handle->packet;
+  len = handle->packet->queue_buf_len;
+  memcpy(buf, handle->packet->queue_buf, len);
+  packet_remove(handle->packet);
+  return len;
 }
 /*---------------------------------------------------------------------------*/
 void
 uip_packetqueue_free(struct uip_packetqueue_handle *handle)
 {
   PRINTF("uip_packetqueue_free %p\n", handle);
-  if(handle->packet != NULL) {
-    ctimer_stop(&handle->packet->lifetimer);
-    memb_free(&packets_memb, handle->packet);
-    handle->packet = NULL;
+  while(handle->packet != NULL) {
+    packet_remove(handle->packet);
   }
 }
 /*---------------------------------------------------------------------------*/
-uint8_t *
-uip_packetqueue_buf(struct uip_packetqueue_handle *h)
-{
-  return h->packet != NULL? h->packet->queue_buf: NULL;
-}
-/*---------------------------------------------------------------------------*/
 uint16_t
 uip_packetqueue_buflen(struct uip_packetqueue_handle *h)
 {
   return h->packet != NULL? h->packet->queue_buf_len: 0;
 }
 /*---------------------------------------------------------------------------*/
-void
-uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len)
+const struct uip_packetqueue_stats *
+uip_packetqueue_get_stats(void)
 {
-  if(h->packet != NULL) {
-    h->packet->queue_buf_len = len;
-  }
+  return &stats;
 }
 /*---------------------------------------------------------------------------*/
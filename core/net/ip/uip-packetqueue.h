@@ -3,33 +3,64 @@
 
 #include "sys/ctimer.h"
 
+/* Number of packets in the pool shared by all queues */
+#ifdef UIP_PACKETQUEUE_CONF_NUM
+#define UIP_PACKETQUEUE_NUM UIP_PACKETQUEUE_CONF_NUM
+#else
+#define UIP_PACKETQUEUE_NUM 2
+#endif
+
+/* Maximum number of packets a single queue may hold */
+#ifdef UIP_PACKETQUEUE_CONF_MAX_PER_HANDLE
+#define UIP_PACKETQUEUE_MAX_PER_HANDLE UIP_PACKETQUEUE_CONF_MAX_PER_HANDLE
+#else
+#define UIP_PACKETQUEUE_MAX_PER_HANDLE 2
+#endif
+
 struct uip_packetqueue_handle;
 
 struct uip_packetqueue_packet {
-  struct uip_ds6_queued_packet *next;
+  struct uip_packetqueue_packet *next;
   uint8_t queue_buf[UIP_BUFSIZE - UIP_LLH_LEN];
   uint16_t queue_buf_len;
   struct ctimer lifetimer;
   struct uip_packetqueue_handle *handle;
 };
 
+/* A FIFO of packets, oldest first */
 struct uip_packetqueue_handle {
   struct uip_packetqueue_packet *packet;
+  uint8_t len;
 };
 
-void uip_packetqueue_new(struct uip_packetqueue_handle *handle);
+struct uip_packetqueue_stats {
+  uint16_t queued;
+  /* Dropped because the pool was empty */
+  uint16_t dropped_pool;
+  /* Dropped because the queue held UIP_PACKETQUEUE_MAX_PER_HANDLE packets */
+  uint16_t dropped_limit;
+  /* Dropped because their lifetime expired while queued */
+  uint16_t expired;
+};
 
+void uip_packetqueue_new(struct uip_packetqueue_handle *handle);
 
-struct uip_packetqueue_packet *
-uip_packetqueue_alloc(struct uip_packetqueue_handle *handle, clock_time_t lifetime);
+/* Append a copy of buf to the queue, dropped after lifetime */
+int uip_packetqueue_enqueue(struct uip_packetqueue_handle *handle,
+                            const void *buf, uint16_t len,
+                            clock_time_t lifetime);
 
+/* Copy the oldest packet to buf and remove it, returns its length */
+uint16_t uip_packetqueue_dequeue(struct uip_packetqueue_handle *handle,
+                                 void *buf);
 
+/* Drop all packets of the queue */
 void
 uip_packetqueue_free(struct uip_packetqueue_handle *handle);
 
-uint8_t *uip_packetqueue_buf(struct uip_packetqueue_handle *h);
+/* Length of the oldest packet, 0 if the queue is empty */
 uint16_t uip_packetqueue_buflen(struct uip_packetqueue_handle *h);
-void uip_packetqueue_set_buflen(struct uip_packetqueue_handle *h, uint16_t len);
 
+const struct uip_packetqueue_stats *uip_packetqueue_get_stats(void);
 
 #endif /* UIP_PACKETQUEUE_H */
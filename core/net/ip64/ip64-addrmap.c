@@ -32,7 +32,6 @@
 #include "ip64-addrmap.h"
 
 #include "lib/memb.h"
-#include "lib/list.h"
 
 #include "ip64-conf.h"
 
@@ -46,8 +45,24 @@
 #define NUM_ENTRIES 32
 #endif /* IP64_ADDRMAP_CONF_ENTRIES */
 
+/* Number of buckets in each of the two hash indexes. With one bucket
+   per entry, a lookup compares against one entry on average. */
+#ifdef IP64_ADDRMAP_CONF_HASH_BUCKETS
+#define HASH_BUCKETS IP64_ADDRMAP_CONF_HASH_BUCKETS
+#else /* IP64_ADDRMAP_CONF_HASH_BUCKETS */
+#define HASH_BUCKETS NUM_ENTRIES
+#endif /* IP64_ADDRMAP_CONF_HASH_BUCKETS */
+
 MEMB(entrymemb, struct ip64_addrmap_entry, NUM_ENTRIES);
-LIST(entrylist);
+
+/* All mappings, ordered by last use so that stale mappings gather at
+   the head, and the recyclable ones in a list of their own so that
+   recycle() does not have to search for them. */
+static struct ip64_addrmap_entry *entries_head, *entries_tail;
+static struct ip64_addrmap_entry *recycle_head, *recycle_tail;
+
+static struct ip64_addrmap_entry *tuple_hash[HASH_BUCKETS];
+static struct ip64_addrmap_entry *port_hash[HASH_BUCKETS];
 
 #define FIRST_MAPPED_PORT 10000
 #define LAST_MAPPED_PORT  20000
@@ -55,74 +70,188 @@ static uint16_t mapped_port = FIRST_MAPPED_PORT;
 
 #define printf(...)
 
+/*---------------------------------------------------------------------------*/
+static unsigned
+hash_tuple(const uip_ip6addr_t *ip6addr, uint16_t ip6port,
+           const uip_ip4addr_t *ip4addr, uint16_t ip4port,
+           uint8_t protocol)
+{
+  uint16_t h;
+
+  /* Only the interface identifier of the IPv6 address is used: the
+     hosts behind the router usually share the prefix. */
+  h = protocol;
+  h = h * 31 + ip6addr->u16[4];
+  h = h * 31 + ip6addr->u16[5];
+  h = h * 31 + ip6addr->u16[6];
+  h = h * 31 + ip6addr->u16[7];
+  h = h * 31 + ip6port;
+  h = h * 31 + ip4addr->u16[0];
+  h = h * 31 + ip4addr->u16[1];
+  h = h * 31 + ip4port;
+  return h % HASH_BUCKETS;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+hash_port(uint16_t port)
+{
+  return port % HASH_BUCKETS;
+}
+/*---------------------------------------------------------------------------*/
+static void
+entries_remove(struct ip64_addrmap_entry *m)
+{
+  if(m->prev != NULL) {
+    m->prev->next = m->next;
+  } else {
+    entries_head = m->next;
+  }
+  if(m->next != NULL) {
+    m->next->prev = m->prev;
+  } else {
+    entries_tail = m->prev;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+entries_add_tail(struct ip64_addrmap_entry *m)
+{
+  m->next = NULL;
+  m->prev = entries_tail;
+  if(entries_tail != NULL) {
+    entries_tail->next = m;
+  } else {
+    entries_head = m;
+  }
+  entries_tail = m;
+}
+/*---------------------------------------------------------------------------*/
+static void
+recycle_remove(struct ip64_addrmap_entry *m)
+{
+  if(m->recycle_prev != NULL) {
+    m->recycle_prev->recycle_next = m->recycle_next;
+  } else {
+    recycle_head = m->recycle_next;
+  }
+  if(m->recycle_next != NULL) {
+    m->recycle_next->recycle_prev = m->recycle_prev;
+  } else {
+    recycle_tail = m->recycle_prev;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+recycle_add_tail(struct ip64_addrmap_entry *m)
+{
+  m->recycle_next = NULL;
+  m->recycle_prev = recycle_tail;
+  if(recycle_tail != NULL) {
+    recycle_tail->recycle_next = m;
+  } else {
+    recycle_head = m;
+  }
+  recycle_tail = m;
+}
+/*---------------------------------------------------------------------------*/
+/* Marks a mapping as the most recently used one. */
+static void
+touch(struct ip64_addrmap_entry *m)
+{
+  if(m != entries_tail) {
+    entries_remove(m);
+    entries_add_tail(m);
+  }
+  if((m->flags & FLAGS_RECYCLABLE) && m != recycle_tail) {
+    recycle_remove(m);
+    recycle_add_tail(m);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_entry(struct ip64_addrmap_entry *m)
+{
+  struct ip64_addrmap_entry **p;
+
+  for(p = &tuple_hash[hash_tuple(&m->ip6addr, m->ip6port,
+                                 &m->ip4addr, m->ip4port, m->protocol)];
+      *p != NULL; p = &(*p)->tuple_next) {
+    if(*p == m) {
+      *p = m->tuple_next;
+      break;
+    }
+  }
+  for(p = &port_hash[hash_port(m->mapped_port)];
+      *p != NULL; p = &(*p)->port_next) {
+    if(*p == m) {
+      *p = m->port_next;
+      break;
+    }
+  }
+  entries_remove(m);
+  if(m->flags & FLAGS_RECYCLABLE) {
+    recycle_remove(m);
+  }
+  memb_free(&entrymemb, m);
+}
 /*---------------------------------------------------------------------------*/
 struct ip64_addrmap_entry *
 ip64_addrmap_list(void)
 {
-  return list_head(entrylist);
+  return entries_head;
 }
 /*---------------------------------------------------------------------------*/
 void
 ip64_addrmap_init(void)
 {
   memb_init(&entrymemb);
-  list_init(entrylist);
+  entries_head = entries_tail = NULL;
+  recycle_head = recycle_tail = NULL;
+  memset(tuple_hash, 0, sizeof(tuple_hash));
+  memset(port_hash, 0, sizeof(port_hash));
   mapped_port = FIRST_MAPPED_PORT;
 }
 /*---------------------------------------------------------------------------*/
 static void
 check_age(void)
 {
-  struct ip64_addrmap_entry *m;
+  /* Throw away the mappings that are too old. The least recently
+     used mappings are at the head of the list, so we stop at the
+     first one that is still alive instead of walking the whole
+     list. Expired mappings further down are removed when a lookup
+     hits them, or by purge_expired() when the table is full. */
+  while(entries_head != NULL && timer_expired(&entries_head->timer)) {
+    remove_entry(entries_head);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+purge_expired(void)
+{
+  struct ip64_addrmap_entry *m, *next;
+  int removed;
 
-  /* Walk through the list of address mappings, throw away the ones
-     that are too old. */
-  m = list_head(entrylist);
-  while(m != NULL) {
+  removed = 0;
+  for(m = entries_head; m != NULL; m = next) {
+    next = m->next;
     if(timer_expired(&m->timer)) {
-      list_remove(entrylist, m);
-      memb_free(&entrymemb, m);
-      m = list_head(entrylist);
-    } else {
-      m = list_item_next(m);
+      remove_entry(m);
+      removed = 1;
     }
   }
+  return removed;
 }
 /*---------------------------------------------------------------------------*/
 static int
 recycle(void)
 {
-  /* Find the oldest recyclable mapping and remove it. */
-  struct ip64_addrmap_entry *m, *oldest;
-
-  /* Walk through the list of address mappings, throw away the ones
-     that are too old. */
-
-  oldest = NULL;
-  for(m = list_head(entrylist);
-      m != NULL;
-      m = list_item_next(m)) {
-    if(m->flags & FLAGS_RECYCLABLE) {
-      if(oldest == NULL) {
-        oldest = m;
-      } else {
-        if(timer_remaining(&m->timer) <
-           timer_remaining(&oldest->timer)) {
-          oldest = m;
-        }
-      }
-    }
-  }
-
-  /* If we found an oldest recyclable entry, remove it and return
-     non-zero. */
-  if(oldest != NULL) {
-    list_remove(entrylist, oldest);
-    memb_free(&entrymemb, oldest);
+  /* Remove the least recently used recyclable mapping, or, if there
+     is none, any mapping that has expired. */
+  if(recycle_head != NULL) {
+    remove_entry(recycle_head);
     return 1;
   }
-
-  return 0;
+  return purge_expired();
 }
 /*---------------------------------------------------------------------------*/
 struct ip64_addrmap_entry *
@@ -137,7 +266,8 @@ ip64_addrmap_lookup(const uip_ip6addr_t *ip6addr,
   printf("lookup ip4port %d ip6port %d\n", uip_htons(ip4port),
 	 uip_htons(ip6port));
   check_age();
-  for(m = list_head(entrylist); m != NULL; m = list_item_next(m)) {
+  for(m = tuple_hash[hash_tuple(ip6addr, ip6port, ip4addr, ip4port, protocol)];
+      m != NULL; m = m->tuple_next) {
     printf("protocol %d %d, ip4port %d %d, ip6port %d %d, ip4 %d ip6 %d\n",
 	   m->protocol, protocol,
 	   m->ip4port, ip4port,
@@ -149,6 +279,11 @@ ip64_addrmap_lookup(const uip_ip6addr_t *ip6addr,
        m->ip6port == ip6port &&
        uip_ip4addr_cmp(&m->ip4addr, ip4addr) &&
        uip_ip6addr_cmp(&m->ip6addr, ip6addr)) {
+      if(timer_expired(&m->timer)) {
+        remove_entry(m);
+        return NULL;
+      }
+      touch(m);
       m->ip6to4++;
       return m;
     }
@@ -162,12 +297,17 @@ ip64_addrmap_lookup_port(uint16_t mapped_port, uint8_t protocol)
   struct ip64_addrmap_entry *m;
 
   check_age();
-  for(m = list_head(entrylist); m != NULL; m = list_item_next(m)) {
+  for(m = port_hash[hash_port(mapped_port)]; m != NULL; m = m->port_next) {
     printf("mapped port %d %d, protocol %d %d\n",
 	   m->mapped_port, mapped_port,
 	   m->protocol, protocol);
     if(m->mapped_port == mapped_port &&
        m->protocol == protocol) {
+      if(timer_expired(&m->timer)) {
+        remove_entry(m);
+        return NULL;
+      }
+      touch(m);
       m->ip4to6++;
       return m;
     }
@@ -175,6 +315,19 @@ ip64_addrmap_lookup_port(uint16_t mapped_port, uint8_t protocol)
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+static int
+mapped_port_in_use(uint16_t port)
+{
+  struct ip64_addrmap_entry *m;
+
+  for(m = port_hash[hash_port(port)]; m != NULL; m = m->port_next) {
+    if(m->mapped_port == port) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
 static void
 increase_mapped_port(void)
 {
@@ -190,6 +343,7 @@ ip64_addrmap_create(const uip_ip6addr_t *ip6addr,
 		    uint8_t protocol)
 {
   struct ip64_addrmap_entry *m;
+  unsigned h;
 
   check_age();
   m = memb_alloc(&entrymemb);
@@ -214,22 +368,20 @@ ip64_addrmap_create(const uip_ip6addr_t *ip6addr,
     /* Pick a new, unused local port. First make sure that the
        mapped_port number does not belong to any active connection. If
        so, we keep increasing the mapped_port until we're free. */
-    {
-      struct ip64_addrmap_entry *n;
-      n = list_head(entrylist);
-      while(n != NULL) {
-	if(n->mapped_port == mapped_port) {
-	  increase_mapped_port();
-	  n = list_head(entrylist);
-	} else {
-	  n = list_item_next(m);
-	}
-      }
+    while(mapped_port_in_use(mapped_port)) {
+      increase_mapped_port();
     }
     m->mapped_port = mapped_port;
     increase_mapped_port();
 
-    list_add(entrylist, m);
+    h = hash_tuple(ip6addr, ip6port, ip4addr, ip4port, protocol);
+    m->tuple_next = tuple_hash[h];
+    tuple_hash[h] = m;
+    h = hash_port(m->mapped_port);
+    m->port_next = port_hash[h];
+    port_hash[h] = m;
+
+    entries_add_tail(m);
     return m;
   }
   return NULL;
@@ -247,8 +399,9 @@ ip64_addrmap_set_lifetime(struct ip64_addrmap_entry *e,
 void
 ip64_addrmap_set_recycleble(struct ip64_addrmap_entry *e)
 {
-  if(e != NULL) {
+  if(e != NULL && !(e->flags & FLAGS_RECYCLABLE)) {
     e->flags |= FLAGS_RECYCLABLE;
+    recycle_add_tail(e);
   }
 }
 /*---------------------------------------------------------------------------*/
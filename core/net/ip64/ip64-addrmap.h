@@ -37,7 +37,12 @@
 #include "net/ip/uip.h"
 
 struct ip64_addrmap_entry {
-  struct ip64_addrmap_entry *next;
+  /* All mappings, least recently used first */
+  struct ip64_addrmap_entry *next, *prev;
+  /* Recyclable mappings, least recently used first */
+  struct ip64_addrmap_entry *recycle_next, *recycle_prev;
+  /* Hash chains on the IPv6 side tuple and on the mapped port */
+  struct ip64_addrmap_entry *tuple_next, *port_next;
   struct timer timer;
   uip_ip6addr_t ip6addr;
   uip_ip4addr_t ip4addr;
@@ -97,7 +102,8 @@ void ip64_addrmap_set_lifetime(struct ip64_addrmap_entry *e,
 void ip64_addrmap_set_recycleble(struct ip64_addrmap_entry *e);
 
 /**
- * Obtain the list of all address mappings.
+ * Obtain the list of all address mappings, least recently used
+ * first. The list is linked through the next field.
  */
 struct ip64_addrmap_entry *ip64_addrmap_list(void);
 #endif /* IP64_ADDRMAP_H */
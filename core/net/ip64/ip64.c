@@ -61,6 +61,7 @@
 #include "ip64-slip-interface.h"
 #include "ip64-dns64.h"
 #include "net/ipv6/uip-ds6.h"
+#include "net/ip/uip-chksum.h"
 #include "ip64-ipv4-dhcp.h"
 #include "contiki-net.h"
 
@@ -269,43 +270,54 @@ ip64_set_ipv6_address(const uip_ip6addr_t *addr)
 }
 /*---------------------------------------------------------------------------*/
 static uint16_t
-chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+ipv4_checksum(struct ipv4_hdr *hdr)
 {
-  uint16_t t;
-  const uint8_t *dataptr;
-  const uint8_t *last_byte;
-
-  dataptr = data;
-  last_byte = data + len - 1;
-
-  while(dataptr < last_byte) {	/* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;		/* carry */
-    }
-    dataptr += 2;
-  }
+  uint16_t sum;
 
-  if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;		/* carry */
-    }
+  sum = uip_chksum_add(0, (uint8_t *)hdr, IPV4_HDRLEN);
+  return (sum == 0) ? 0xffff : uip_htons(sum);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+ipv4_pseudohdr_sum(const struct ipv4_hdr *v4hdr, uint16_t transport_layer_len,
+                   uint8_t proto)
+{
+  uint16_t sum;
+
+  if(proto == IP_PROTO_ICMPV4) {
+    /* ping replies' checksums are calculated over the icmp-part only */
+    return 0;
   }
 
-  /* Return sum in host byte order. */
-  return sum;
+  /* IP protocol and length fields. This addition cannot carry. */
+  sum = transport_layer_len + proto;
+  /* Sum IP source and destination addresses. */
+  return uip_chksum_add(sum, (uint8_t *)&v4hdr->srcipaddr,
+                        2 * sizeof(uip_ip4addr_t));
 }
 /*---------------------------------------------------------------------------*/
 static uint16_t
-ipv4_checksum(struct ipv4_hdr *hdr)
+ipv6_pseudohdr_sum(const struct ipv6_hdr *v6hdr, uint16_t transport_layer_len,
+                   uint8_t proto)
 {
   uint16_t sum;
 
-  sum = chksum(0, (uint8_t *)hdr, IPV4_HDRLEN);
-  return (sum == 0) ? 0xffff : uip_htons(sum);
+  /* IP protocol and length fields. This addition cannot carry. */
+  sum = transport_layer_len + proto;
+  /* Sum IP source and destination addresses. */
+  return uip_chksum_add(sum, (uint8_t *)&v6hdr->srcipaddr,
+                        2 * sizeof(uip_ip6addr_t));
+}
+/*---------------------------------------------------------------------------*/
+/* Moves a transport layer checksum, as stored in the packet, from one
+   pseudo-header to another (RFC 1624). The transport layer data is
+   not read, so the cost of a translation does not depend on the
+   payload size, and a payload that was corrupted before the
+   translation is still caught by the receiver. */
+static uint16_t
+pseudohdr_update(uint16_t chksum, uint16_t old_sum, uint16_t new_sum)
+{
+  return uip_chksum_update16(chksum, uip_htons(old_sum), uip_htons(new_sum));
 }
 /*---------------------------------------------------------------------------*/
 static uint16_t
@@ -318,19 +330,10 @@ ipv4_transport_checksum(const uint8_t *packet, uint16_t len, uint8_t proto)
   transport_layer_len = len - IPV4_HDRLEN;
 
   /* First sum pseudoheader. */
-
-  if(proto != IP_PROTO_ICMPV4) {
-    /* IP protocol and length fields. This addition cannot carry. */
-    sum = transport_layer_len + proto;
-    /* Sum IP source and destination addresses. */
-    sum = chksum(sum, (uint8_t *)&v4hdr->srcipaddr, 2 * sizeof(uip_ip4addr_t));
-  } else {
-    /* ping replies' checksums are calculated over the icmp-part only */
-    sum = 0;
-  }
+  sum = ipv4_pseudohdr_sum(v4hdr, transport_layer_len, proto);
 
   /* Sum transport layer header and data. */
-  sum = chksum(sum, &packet[IPV4_HDRLEN], transport_layer_len);
+  sum = uip_chksum_add(sum, &packet[IPV4_HDRLEN], transport_layer_len);
 
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
@@ -345,15 +348,10 @@ ipv6_transport_checksum(const uint8_t *packet, uint16_t len, uint8_t proto)
   transport_layer_len = len - IPV6_HDRLEN;
 
   /* First sum pseudoheader. */
-
-  /* IP protocol and length fields. This addition cannot carry. */
-  sum = transport_layer_len + proto;
-  /* Sum IP source and destination addresses. */
-  sum = chksum(sum, (uint8_t *)&v6hdr->srcipaddr, sizeof(uip_ip6addr_t));
-  sum = chksum(sum, (uint8_t *)&v6hdr->destipaddr, sizeof(uip_ip6addr_t));
+  sum = ipv6_pseudohdr_sum(v6hdr, transport_layer_len, proto);
 
   /* Sum transport layer header and data. */
-  sum = chksum(sum, &packet[IPV6_HDRLEN], transport_layer_len);
+  sum = uip_chksum_add(sum, &packet[IPV6_HDRLEN], transport_layer_len);
 
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
@@ -369,10 +367,14 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
   struct icmpv4_hdr *icmpv4hdr;
   struct icmpv6_hdr *icmpv6hdr;
   uint16_t ipv6len, ipv4len;
+  uint16_t srcport;
+  uint16_t old_sum, new_sum;
+  uint8_t payload_rewritten;
   struct ip64_addrmap_entry *m;
 
   v6hdr = (struct ipv6_hdr *)ipv6packet;
   v4hdr = (struct ipv4_hdr *)resultpacket;
+  payload_rewritten = 0;
 
   if((v6hdr->len[0] << 8) + v6hdr->len[1] <= ipv6packet_len) {
     ipv6len = (v6hdr->len[0] << 8) + v6hdr->len[1] + IPV6_HDRLEN;
@@ -392,6 +394,10 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
   icmpv4hdr = (struct icmpv4_hdr *)&resultpacket[IPV4_HDRLEN];
   icmpv6hdr = (struct icmpv6_hdr *)&ipv6packet[IPV6_HDRLEN];
 
+  /* Remember the original source port so that the transport layer
+     checksum can be updated for the port rewrite below. */
+  srcport = udphdr->srcport;
+
   /* Translate the IPv6 header into an IPv4 header. */
 
   /* First the basics: the IPv4 version, header length, type of
@@ -424,15 +430,6 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
   case IP_PROTO_TCP:
     PRINTF("ip64_6to4: TCP header\n");
     v4hdr->proto = IP_PROTO_TCP;
-
-    /* Compute and check the TCP checksum - since we're going to
-       recompute it ourselves, we must ensure that it was correct in
-       the first place. */
-    if(ipv6_transport_checksum(ipv6packet, ipv6len,
-                               IP_PROTO_TCP) != 0xffff) {
-      PRINTF("Bad TCP checksum, dropping packet\n");
-    }
-
     break;
 
   case IP_PROTO_UDP:
@@ -446,13 +443,7 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
                       ipv6len - IPV6_HDRLEN - sizeof(struct udp_hdr),
                       (uint8_t *)udphdr + sizeof(struct udp_hdr),
                       BUFSIZE - IPV4_HDRLEN - sizeof(struct udp_hdr));
-    }
-    /* Compute and check the UDP checksum - since we're going to
-       recompute it ourselves, we must ensure that it was correct in
-       the first place. */
-    if(ipv6_transport_checksum(ipv6packet, ipv6len,
-                               IP_PROTO_UDP) != 0xffff) {
-      PRINTF("Bad UDP checksum, dropping packet\n");
+      payload_rewritten = 1;
     }
     break;
 
@@ -616,25 +607,38 @@ ip64_6to4(const uint8_t *ipv6packet, const uint16_t ipv6packet_len,
 
   /* The checksum is in different places in the different protocol
      headers, so we need to be sure that we update the correct
-     field. */
+     field. Unless the payload was rewritten, the checksum copied
+     from the IPv6 packet is updated for the new pseudo-header and
+     for the rewritten header fields instead of being recomputed. */
+  old_sum = ipv6_pseudohdr_sum(v6hdr, ipv4len - IPV4_HDRLEN, v6hdr->nxthdr);
+  new_sum = ipv4_pseudohdr_sum(v4hdr, ipv4len - IPV4_HDRLEN, v4hdr->proto);
   switch(v4hdr->proto) {
   case IP_PROTO_TCP:
-    tcphdr->tcpchksum = 0;
-    tcphdr->tcpchksum = ~(ipv4_transport_checksum(resultpacket, ipv4len,
-						  IP_PROTO_TCP));
+    tcphdr->tcpchksum = pseudohdr_update(tcphdr->tcpchksum, old_sum, new_sum);
+    tcphdr->tcpchksum = uip_chksum_update16(tcphdr->tcpchksum,
+                                            srcport, tcphdr->srcport);
     break;
   case IP_PROTO_UDP:
-    udphdr->udpchksum = 0;
-    udphdr->udpchksum = ~(ipv4_transport_checksum(resultpacket, ipv4len,
-						  IP_PROTO_UDP));
+    if(payload_rewritten || udphdr->udpchksum == 0) {
+      udphdr->udpchksum = 0;
+      udphdr->udpchksum = ~(ipv4_transport_checksum(resultpacket, ipv4len,
+                                                    IP_PROTO_UDP));
+    } else {
+      udphdr->udpchksum = pseudohdr_update(udphdr->udpchksum, old_sum, new_sum);
+      udphdr->udpchksum = uip_chksum_update16(udphdr->udpchksum,
+                                              srcport, udphdr->srcport);
+    }
     if(udphdr->udpchksum == 0) {
       udphdr->udpchksum = 0xffff;
     }
     break;
   case IP_PROTO_ICMPV4:
-    icmpv4hdr->icmpchksum = 0;
-    icmpv4hdr->icmpchksum = ~(ipv4_transport_checksum(resultpacket, ipv4len,
-						      IP_PROTO_ICMPV4));
+    icmpv4hdr->icmpchksum = pseudohdr_update(icmpv4hdr->icmpchksum,
+                                             old_sum, new_sum);
+    icmpv4hdr->icmpchksum =
+      uip_chksum_update16(icmpv4hdr->icmpchksum,
+                          UIP_HTONS((ICMP6_ECHO_REPLY << 8) | icmpv4hdr->icode),
+                          UIP_HTONS((ICMP_ECHO_REPLY << 8) | icmpv4hdr->icode));
     break;
 
   default:
@@ -658,10 +662,14 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
   struct icmpv4_hdr *icmpv4hdr;
   struct icmpv6_hdr *icmpv6hdr;
   uint16_t ipv4len, ipv6len, ipv6_packet_len;
+  uint16_t destport;
+  uint16_t old_sum, new_sum;
+  uint8_t payload_rewritten;
   struct ip64_addrmap_entry *m;
 
   v6hdr = (struct ipv6_hdr *)resultpacket;
   v4hdr = (struct ipv4_hdr *)ipv4packet;
+  payload_rewritten = 0;
 
   if((v4hdr->len[0] << 8) + v4hdr->len[1] <= ipv4packet_len) {
     ipv4len = (v4hdr->len[0] << 8) + v4hdr->len[1];
@@ -690,6 +698,10 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
   icmpv4hdr = (struct icmpv4_hdr *)&ipv4packet[IPV4_HDRLEN];
   icmpv6hdr = (struct icmpv6_hdr *)&resultpacket[IPV6_HDRLEN];
 
+  /* Remember the original destination port so that the transport
+     layer checksum can be updated for the port rewrite below. */
+  destport = udphdr->destport;
+
   ipv6len = ipv4len - IPV4_HDRLEN + IPV6_HDRLEN;
   ipv6_packet_len = ipv6len - IPV6_HDRLEN;
 
@@ -741,7 +753,7 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
       v6hdr->len[0] = ipv6_packet_len >> 8;
       v6hdr->len[1] = ipv6_packet_len & 0xff;
       ipv6len = ipv6_packet_len + IPV6_HDRLEN;
-
+      payload_rewritten = 1;
     }
     break;
 
@@ -851,29 +863,41 @@ ip64_4to6(const uint8_t *ipv4packet, const uint16_t ipv4packet_len,
 
   /* The checksum is in different places in the different protocol
      headers, so we need to be sure that we update the correct
-     field. */
+     field. Unless the payload was rewritten, or the IPv4 sender did
+     not compute a UDP checksum, the checksum copied from the IPv4
+     packet is updated for the new pseudo-header and for the
+     rewritten header fields instead of being recomputed. */
+  old_sum = ipv4_pseudohdr_sum(v4hdr, ipv4len - IPV4_HDRLEN, v4hdr->proto);
+  new_sum = ipv6_pseudohdr_sum(v6hdr, ipv6_packet_len, v6hdr->nxthdr);
   switch(v6hdr->nxthdr) {
   case IP_PROTO_TCP:
-    tcphdr->tcpchksum = 0;
-    tcphdr->tcpchksum = ~(ipv6_transport_checksum(resultpacket,
-						  ipv6len,
-						  IP_PROTO_TCP));
+    tcphdr->tcpchksum = pseudohdr_update(tcphdr->tcpchksum, old_sum, new_sum);
+    tcphdr->tcpchksum = uip_chksum_update16(tcphdr->tcpchksum,
+                                            destport, tcphdr->destport);
     break;
   case IP_PROTO_UDP:
-    udphdr->udpchksum = 0;
-    udphdr->udpchksum = ~(ipv6_transport_checksum(resultpacket,
-						  ipv6len,
-						  IP_PROTO_UDP));
+    if(payload_rewritten || udphdr->udpchksum == 0) {
+      udphdr->udpchksum = 0;
+      udphdr->udpchksum = ~(ipv6_transport_checksum(resultpacket,
+                                                    ipv6len,
+                                                    IP_PROTO_UDP));
+    } else {
+      udphdr->udpchksum = pseudohdr_update(udphdr->udpchksum, old_sum, new_sum);
+      udphdr->udpchksum = uip_chksum_update16(udphdr->udpchksum,
+                                              destport, udphdr->destport);
+    }
     if(udphdr->udpchksum == 0) {
       udphdr->udpchksum = 0xffff;
     }
     break;
 
   case IP_PROTO_ICMPV6:
-    icmpv6hdr->icmpchksum = 0;
-    icmpv6hdr->icmpchksum = ~(ipv6_transport_checksum(resultpacket,
-                                                ipv6len,
-                                                IP_PROTO_ICMPV6));
+    icmpv6hdr->icmpchksum = pseudohdr_update(icmpv6hdr->icmpchksum,
+                                             old_sum, new_sum);
+    icmpv6hdr->icmpchksum =
+      uip_chksum_update16(icmpv6hdr->icmpchksum,
+                          UIP_HTONS((ICMP_ECHO << 8) | icmpv6hdr->icode),
+                          UIP_HTONS((ICMP6_ECHO << 8) | icmpv6hdr->icode));
     break;
   default:
     PRINTF("ip64_4to6: transport protocol %d not implemented\n", v4hdr->proto);
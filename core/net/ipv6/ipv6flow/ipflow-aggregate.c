@@ -0,0 +1,259 @@
+/**
+ * \file
+ *    Aggregation levels of the Contiki netflow engine.
+ *    Every level is a small table of (key, octets, packets) entries,
+ *    reset after each export. All levels share one IPFIX structure and
+ *    one template, set up for a level right before its message is
+ *    generated, so each level leaves in its own small message.
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "net/ipv6/ipv6flow/ipflow-aggregate.h"
+
+#if IPFLOW_AGGREGATE_LEVELS
+#include "lib/list.h"
+#include "lib/memb.h"
+#include "net/ipv6/uip-ds6.h"
+#if UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl.h"
+#endif
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+#define LEVELS 4
+#define LEVEL_ENABLED(i) ((IPFLOW_AGGREGATE_LEVELS & (1 << (i))) != 0)
+#define NUMBER_LEVELS (LEVEL_ENABLED(0) + LEVEL_ENABLED(1) + \
+                       LEVEL_ENABLED(2) + LEVEL_ENABLED(3))
+
+MEMB(aggregate_memb, ipflow_aggregate_t, NUMBER_LEVELS * IPFLOW_AGGREGATE_ENTRIES);
+LIST(prefix_table);
+LIST(dodag_table);
+LIST(neighbor_table);
+LIST(protocol_table);
+
+static list_t tables[LEVELS];
+static ipfix_t *aggregate_ipfix = NULL;
+static template_t *aggregate_template = NULL;
+static int current_level = 0;
+static ipflow_aggregate_t *temp_aggregate = NULL;
+
+// Template and key element of each level, octet and packet counts follow
+static const uint16_t template_ids[LEVELS] = {
+  IPFLOW_PREFIX_TEMPLATE_ID, IPFLOW_DODAG_TEMPLATE_ID,
+  IPFLOW_NEIGHBOR_TEMPLATE_ID, IPFLOW_PROTOCOL_TEMPLATE_ID
+};
+static const uint16_t key_ids[LEVELS] = { 169, 32783, 63, 4 };
+static const uint16_t key_sizes[LEVELS] = { 16, 16, 16, 1 };
+static const uint32_t key_eids[LEVELS] = { 0, 20763, 0, 0 };
+/*---------------------------------------------------------------------------*/
+static int
+level_index(int level)
+{
+  int i = 0;
+  for(i = 0; i < LEVELS; i++){
+    if(level == (1 << i)){
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+ipflow_aggregate_t *
+get_aggregate_table_head(int level)
+{
+  int i = level_index(level);
+  if(i < 0 || !LEVEL_ENABLED(i)){
+    return NULL;
+  }
+  return list_head(tables[i]);
+}
+/*---------------------------------------------------------------------------*/
+static int
+update_level(int i, const uint8_t *key, uint32_t size, uint32_t packets)
+{
+  ipflow_aggregate_t *entry;
+  for(entry = list_head(tables[i]); entry != NULL; entry = entry -> next){
+    if(memcmp(entry -> key, key, IPFLOW_AGGREGATE_KEY_LENGTH) == 0){
+      break;
+    }
+  }
+
+  if(entry == NULL){
+    if(list_length(tables[i]) >= IPFLOW_AGGREGATE_ENTRIES){
+      return 0;
+    }
+    entry = memb_alloc(&aggregate_memb);
+    if(entry == NULL){
+      return 0;
+    }
+    memcpy(entry -> key, key, IPFLOW_AGGREGATE_KEY_LENGTH);
+    entry -> size = 0;
+    entry -> packets = 0;
+    list_add(tables[i], entry);
+  }
+
+  entry -> size = (entry -> size) + size;
+  entry -> packets = (entry -> packets) + packets;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+next_hop(const uip_ipaddr_t *destination, uip_ipaddr_t *addr)
+{
+  uip_ds6_route_t *route;
+  uip_ipaddr_t *defrt;
+
+  memset(addr, 0, sizeof(uip_ipaddr_t));
+  if(uip_is_addr_mcast(destination) ||
+     uip_ds6_is_addr_onlink((uip_ipaddr_t *)destination)){
+    *addr = *destination;
+    return;
+  }
+  route = uip_ds6_route_lookup((uip_ipaddr_t *)destination);
+  if(route != NULL){
+    *addr = *uip_ds6_route_nexthop(route);
+    return;
+  }
+  defrt = uip_ds6_defrt_choose();
+  if(defrt != NULL){
+    *addr = *defrt;
+  }
+  // Unknown next hop is accounted under ::
+}
+/*---------------------------------------------------------------------------*/
+int
+ipflow_aggregate_update(const uip_ipaddr_t *destination, uint8_t proto,
+  uint32_t size, uint32_t packets)
+{
+  uint8_t key[IPFLOW_AGGREGATE_KEY_LENGTH];
+  int accounted = 1;
+
+  if(LEVEL_ENABLED(0)){
+    memset(key, 0, sizeof(key));
+    memcpy(key, destination, 8);
+    accounted &= update_level(0, key, size, packets);
+  }
+  if(LEVEL_ENABLED(1)){
+    memset(key, 0, sizeof(key));
+#if UIP_CONF_IPV6_RPL
+    rpl_dag_t *dag = rpl_get_any_dag();
+    if(dag != NULL){
+      memcpy(key, &(dag -> dag_id), sizeof(key));
+    }
+#endif /* UIP_CONF_IPV6_RPL */
+    accounted &= update_level(1, key, size, packets);
+  }
+  if(LEVEL_ENABLED(2)){
+    next_hop(destination, (uip_ipaddr_t *)key);
+    accounted &= update_level(2, key, size, packets);
+  }
+  if(LEVEL_ENABLED(3)){
+    memset(key, 0, sizeof(key));
+    key[0] = proto;
+    accounted &= update_level(3, key, size, packets);
+  }
+  return accounted;
+}
+/*---------------------------------------------------------------------------*/
+void
+ipflow_aggregate_flush(int level)
+{
+  int i = level_index(level);
+  ipflow_aggregate_t *entry;
+  if(i < 0){
+    return;
+  }
+  for(entry = list_pop(tables[i]); entry != NULL; entry = list_pop(tables[i])){
+    memb_free(&aggregate_memb, entry);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t *
+reversed_key()
+{
+  // Values are converted to big endian by reversing them, addresses
+  // already are in network order
+  static uint8_t key[IPFLOW_AGGREGATE_KEY_LENGTH];
+  int i = 0;
+  for(i = 0; i < IPFLOW_AGGREGATE_KEY_LENGTH; i++){
+    key[i] = temp_aggregate -> key[IPFLOW_AGGREGATE_KEY_LENGTH - i - 1];
+  }
+  return key;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_aggregate_key()
+{
+  if(current_level == 3){
+    // Protocol number, a single byte
+    return &(temp_aggregate -> key[0]);
+  }
+  // Prefix, DODAG ID or next hop address
+  return reversed_key();
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_aggregate_octet_count()
+{
+  return (uint8_t *)&(temp_aggregate -> size);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_aggregate_packet_count()
+{
+  ipflow_aggregate_t *entry = temp_aggregate;
+  temp_aggregate = temp_aggregate -> next;
+  return (uint8_t *)&(entry -> packets);
+}
+/*---------------------------------------------------------------------------*/
+// Called right before the records are encoded, so it also points the
+// getters to the head of the current level's table.
+static int
+number_records()
+{
+  temp_aggregate = list_head(tables[current_level]);
+  return list_length(tables[current_level]);
+}
+/*---------------------------------------------------------------------------*/
+ipfix_t *
+ipflow_aggregate_ipfix(int level)
+{
+  int i = level_index(level);
+  information_element_t *key;
+  if(i < 0 || !LEVEL_ENABLED(i)){
+    return NULL;
+  }
+  current_level = i;
+  aggregate_template -> id = template_ids[i];
+  key = aggregate_template -> element_head;
+  key -> id = key_ids[i];
+  key -> size = key_sizes[i];
+  key -> eid = key_eids[i];
+  return aggregate_ipfix;
+}
+/*---------------------------------------------------------------------------*/
+void
+ipflow_aggregate_init()
+{
+  template_t *template;
+
+  tables[0] = prefix_table;
+  tables[1] = dodag_table;
+  tables[2] = neighbor_table;
+  tables[3] = protocol_table;
+  int i = 0;
+  for(i = 0; i < LEVELS; i++){
+    list_init(tables[i]);
+  }
+  memb_init(&aggregate_memb);
+
+  // Key element is rewritten by ipflow_aggregate_ipfix() for each level
+  template = create_ipfix_template(IPFLOW_PREFIX_TEMPLATE_ID, &number_records);
+  add_element_to_template(template, AGGREGATE_KEY);
+  add_element_to_template(template, AGGREGATE_OCTET_DELTA_COUNT);
+  add_element_to_template(template, AGGREGATE_PACKET_DELTA_COUNT);
+  aggregate_template = template;
+  aggregate_ipfix = create_ipfix();
+  add_templates_to_ipfix(aggregate_ipfix, template);
+}
+/*---------------------------------------------------------------------------*/
+#endif /* IPFLOW_AGGREGATE_LEVELS */
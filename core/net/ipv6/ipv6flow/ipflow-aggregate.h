@@ -0,0 +1,79 @@
+/**
+ * \file
+ *    Header file for the aggregation levels of the Contiki netflow engine.
+ *    Besides per-destination flows, traffic can be totalled per /64
+ *    destination prefix, per RPL DODAG, per next-hop neighbor and per
+ *    upper-layer protocol. Each level has its own small table and IPFIX
+ *    template, and is exported in its own message after the flows.
+ */
+/*---------------------------------------------------------------------------*/
+#ifndef IPFLOW_AGGREGATE_H_
+#define IPFLOW_AGGREGATE_H_
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/tinyipfix/tipfix.h"
+/*---------------------------------------------------------------------------*/
+#define IPFLOW_LEVEL_PREFIX   0x01
+#define IPFLOW_LEVEL_DODAG    0x02
+#define IPFLOW_LEVEL_NEIGHBOR 0x04
+#define IPFLOW_LEVEL_PROTOCOL 0x08
+
+// Levels kept, none by default
+#ifdef IPFLOW_CONF_AGGREGATE_LEVELS
+#define IPFLOW_AGGREGATE_LEVELS IPFLOW_CONF_AGGREGATE_LEVELS
+#else
+#define IPFLOW_AGGREGATE_LEVELS 0
+#endif
+
+// Entries per level, traffic that does not fit is not accounted
+#ifdef IPFLOW_CONF_AGGREGATE_ENTRIES
+#define IPFLOW_AGGREGATE_ENTRIES IPFLOW_CONF_AGGREGATE_ENTRIES
+#else
+#define IPFLOW_AGGREGATE_ENTRIES 4
+#endif
+
+#define IPFLOW_PREFIX_TEMPLATE_ID 258
+#define IPFLOW_DODAG_TEMPLATE_ID 259
+#define IPFLOW_NEIGHBOR_TEMPLATE_ID 260
+#define IPFLOW_PROTOCOL_TEMPLATE_ID 261
+
+#define IPFLOW_AGGREGATE_KEY_LENGTH 16
+/* One level per message, key and two 4 bytes counters per record. Room
+ * for two records at least, the template message needs as much. */
+#define IPFLOW_AGGREGATE_MESSAGE_LENGTH (IPFIX_HEADER_LENGTH + \
+  IPFIX_SET_HEADER_LENGTH + (IPFLOW_AGGREGATE_ENTRIES < 2 ? 2 : \
+  IPFLOW_AGGREGATE_ENTRIES) * (IPFLOW_AGGREGATE_KEY_LENGTH + 8))
+/*---------------------------------------------------------------------------*/
+
+/** Structures definition **/
+typedef struct ipflow_aggregate{
+  struct ipflow_aggregate *next;
+  uint8_t key[IPFLOW_AGGREGATE_KEY_LENGTH];
+  uint32_t size;
+  uint32_t packets;
+} ipflow_aggregate_t;
+/*---------------------------------------------------------------------------*/
+
+/** Method definition **/
+void ipflow_aggregate_init();
+int ipflow_aggregate_update(const uip_ipaddr_t *destination, uint8_t proto,
+  uint32_t size, uint32_t packets);
+ipfix_t * ipflow_aggregate_ipfix(int level);
+void ipflow_aggregate_flush(int level);
+ipflow_aggregate_t * get_aggregate_table_head(int level);
+
+uint8_t * get_aggregate_key();
+uint8_t * get_aggregate_octet_count();
+uint8_t * get_aggregate_packet_count();
+/*---------------------------------------------------------------------------*/
+
+/** INFORMATION ELEMENTS FIELDS **/
+// destinationIPv6Prefix (169), DODAG ID (32783), ipNextHopIPv6Address (63)
+// or protocolIdentifier (4), depending on the level
+#define AGGREGATE_KEY create_ipfix_information_element(169, 16, 0, &get_aggregate_key)
+#define AGGREGATE_OCTET_DELTA_COUNT create_ipfix_information_element(1, 4, 0, &get_aggregate_octet_count)
+// Moves on to the next entry, must stay the last element
+#define AGGREGATE_PACKET_DELTA_COUNT create_ipfix_information_element(2, 4, 0, &get_aggregate_packet_count)
+
+#endif /* IPFLOW_AGGREGATE_H_ */
@@ -0,0 +1,114 @@
+/**
+ * \file
+ *    IPFIX file writer for the Contiki netflow engine.
+ *    An IPFIX file is a plain sequence of IPFIX messages (RFC 5655).
+ *    Messages are gathered in a buffer and appended to the current file
+ *    when the buffer is full or every IPFLOW_FILE_FLUSH_INTERVAL.
+ */
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "net/ipv6/ipv6flow/ipflow-file.h"
+
+#if IPFLOW_WITH_FILE
+#include "cfs/cfs.h"
+#include <stdio.h>
+#include <string.h>
+/*---------------------------------------------------------------------------*/
+static uint8_t buffer[IPFLOW_FILE_BUFFER_LENGTH];
+static int buffer_length = 0;
+
+static char filename[32];
+static int file_number = 0;
+static long file_size = 0;
+static unsigned long file_opened = 0;
+
+static struct ctimer flush_timer;
+/*---------------------------------------------------------------------------*/
+static void
+next_file()
+{
+  int fd;
+
+  // Skip the files left by a previous run, never append to them
+  do{
+    file_number++;
+    snprintf(filename, sizeof(filename), "%s-%04d.ipfix",
+      IPFLOW_FILE_PREFIX, file_number);
+    fd = cfs_open(filename, CFS_READ);
+    if(fd >= 0){
+      cfs_close(fd);
+    }
+  } while(fd >= 0 && file_number < 9999);
+  file_size = 0;
+  file_opened = clock_seconds();
+}
+/*---------------------------------------------------------------------------*/
+static void
+flush_timeout(void *ptr)
+{
+  ipflow_file_flush();
+  ctimer_reset(&flush_timer);
+}
+/*---------------------------------------------------------------------------*/
+void
+ipflow_file_init()
+{
+  buffer_length = 0;
+  file_number = 0;
+  next_file();
+  ctimer_set(&flush_timer, IPFLOW_FILE_FLUSH_INTERVAL * CLOCK_SECOND,
+    flush_timeout, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+ipflow_file_flush()
+{
+  if(buffer_length == 0){
+    return;
+  }
+
+  int fd = cfs_open(filename, CFS_WRITE | CFS_APPEND);
+  if(fd < 0){
+    // Keep the buffer, we try again on the next flush
+    printf("Could not open %s\n", filename);
+    return;
+  }
+  int written = cfs_write(fd, buffer, buffer_length);
+  cfs_close(fd);
+  if(written != buffer_length){
+    // Retrying would duplicate what did make it, drop the rest
+    printf("Could not write %s\n", filename);
+  }
+
+  if(written > 0){
+    file_size = file_size + written;
+  }
+  buffer_length = 0;
+
+  if(file_size >= IPFLOW_FILE_MAX_SIZE ||
+     clock_seconds() - file_opened >= IPFLOW_FILE_ROTATE_INTERVAL){
+    next_file();
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+ipflow_file_write(uint8_t *message, int length)
+{
+  if(length > IPFLOW_FILE_BUFFER_LENGTH){
+    return 0;
+  }
+  if(buffer_length + length > IPFLOW_FILE_BUFFER_LENGTH){
+    ipflow_file_flush();
+    if(buffer_length + length > IPFLOW_FILE_BUFFER_LENGTH){
+      // Flush failed, drop the message rather than the buffered ones
+      return 0;
+    }
+  }
+
+  // Messages are never split, so each file holds whole messages
+  memcpy(&buffer[buffer_length], message, length);
+  buffer_length = buffer_length + length;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* IPFLOW_WITH_FILE */
@@ -0,0 +1,58 @@
+/**
+ * \file
+ *    Header file for the IPFIX file writer of the Contiki netflow engine.
+ *    Exported IPFIX messages are archived in local files (RFC 5655),
+ *    for platforms with a file system such as native or minimal-net.
+ */
+/*---------------------------------------------------------------------------*/
+#ifndef IPFLOW_FILE_H_
+#define IPFLOW_FILE_H_
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+/*---------------------------------------------------------------------------*/
+#ifdef IPFLOW_CONF_WITH_FILE
+#define IPFLOW_WITH_FILE IPFLOW_CONF_WITH_FILE
+#else
+#define IPFLOW_WITH_FILE 0
+#endif
+
+#ifdef IPFLOW_CONF_FILE_PREFIX
+#define IPFLOW_FILE_PREFIX IPFLOW_CONF_FILE_PREFIX
+#else
+#define IPFLOW_FILE_PREFIX "ipflow"
+#endif
+
+// Messages are gathered in RAM and written in one go
+#ifdef IPFLOW_CONF_FILE_BUFFER_LENGTH
+#define IPFLOW_FILE_BUFFER_LENGTH IPFLOW_CONF_FILE_BUFFER_LENGTH
+#else
+#define IPFLOW_FILE_BUFFER_LENGTH 4096
+#endif
+
+// Buffered messages are written at least this often
+#ifdef IPFLOW_CONF_FILE_FLUSH_INTERVAL
+#define IPFLOW_FILE_FLUSH_INTERVAL IPFLOW_CONF_FILE_FLUSH_INTERVAL
+#else
+#define IPFLOW_FILE_FLUSH_INTERVAL 10 // seconds
+#endif
+
+// A new file is started once the current one reaches either limit
+#ifdef IPFLOW_CONF_FILE_MAX_SIZE
+#define IPFLOW_FILE_MAX_SIZE IPFLOW_CONF_FILE_MAX_SIZE
+#else
+#define IPFLOW_FILE_MAX_SIZE (1024L * 1024L) // bytes
+#endif
+
+#ifdef IPFLOW_CONF_FILE_ROTATE_INTERVAL
+#define IPFLOW_FILE_ROTATE_INTERVAL IPFLOW_CONF_FILE_ROTATE_INTERVAL
+#else
+#define IPFLOW_FILE_ROTATE_INTERVAL 3600 // seconds
+#endif
+/*---------------------------------------------------------------------------*/
+
+/** Method definition **/
+void ipflow_file_init();
+int ipflow_file_write(uint8_t *message, int length);
+void ipflow_file_flush();
+
+#endif /* IPFLOW_FILE_H_ */
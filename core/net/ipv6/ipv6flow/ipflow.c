@@ -11,35 +11,227 @@
 #include "contiki.h"
 #include "lib/list.h"
 #include "lib/memb.h"
+#include "lib/random.h"
+#include "net/linkaddr.h"
 #include "net/ip/uip-udp-packet.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-icmp6.h"
+#include "net/ipv6/uip-packet-observer.h"
+#include "net/mac/mac.h"
 #include "net/ipv6/ipv6flow/ipflow.h"
+#include "net/ipv6/ipv6flow/ipflow-file.h"
+#include "net/ipv6/ipv6flow/ipflow-aggregate.h"
 #include "net/ipv6/tinyipfix/tipfix.h"
 #include "sys/node-id.h"
+#if IPFLOW_WITH_TCP
+#include "net/ip/tcp-socket.h"
+#endif
+#if IPFLOW_WITH_TRAFFIC_HINTS
+#include "net/traffic-hints.h"
+#endif
+#if UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl.h"
+#endif
 #include <stdio.h>
 /*---------------------------------------------------------------------------*/
 #define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_ICMP_BUF ((struct uip_icmp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + uip_ext_len])
 
-#define LIST_FLOWS_NAME flow_table
 #define MEMB_FLOWS_NAME flow_memb
-MEMB(MEMB_FLOWS_NAME, flow_t, MAX_FLOWS);
-LIST(LIST_FLOWS_NAME);
+// Room for a full live table and a full snapshot being exported
+MEMB(MEMB_FLOWS_NAME, flow_t, 2 * MAX_FLOWS);
+LIST(flow_table_a);
+LIST(flow_table_b);
+
+// Packets are accounted in the live table. At the export boundary it
+// becomes the snapshot and a fresh table takes over, so sending the
+// export (which goes through the packet observer) never touches the
+// flows being encoded.
+static list_t live_table = NULL;
+static list_t snapshot_table = NULL;
 
 static int status = 0;
+// Messages are encoded here and copied out by send_message(), too big
+// for the stack of the callers
+static uint8_t export_buffer[IPFLOW_MESSAGE_LENGTH];
 static ipfix_t *ipflow_ipfix = NULL;
+static ipfix_t *stats_ipfix = NULL;
+static ipflow_stats_t stats;
+static int stats_due = 0;
 
 static struct uip_udp_conn *exporter_connection;
-static uip_ipaddr_t collector_addr;
+static uip_ipaddr_t collectors[IPFLOW_MAX_COLLECTORS];
+static unsigned long collectors_failed_at[IPFLOW_MAX_COLLECTORS];
+static int number_collectors = 0;
+static int collectors_mode = IPFLOW_COLLECTORS_FAILOVER;
 static flow_t * temp_flow;
 static int compression = NO_COMPRESSION;
 static int role = STANDARD;
+static int delta_reporting = 0;
+static int transport = IPFLOW_TRANSPORT_UDP;
+static int exports_since_refresh = 0;
+static int sampling_rate = 1;
+static int export_interval = IPFLOW_EXPORT_INTERVAL;
+static struct etimer periodic;
+#if UIP_PACKET_OBSERVERS
+static struct uip_packet_observer observer;
+#endif
 /*---------------------------------------------------------------------------*/
 static void initialize();
 static int cmp_ipaddr(uip_ipaddr_t *in, uip_ipaddr_t *out);
 static flow_t * create_flow(uip_ipaddr_t *destination, uint16_t size, uint16_t packets);
+static flow_t * find_flow(uip_ipaddr_t *destination);
+#if UIP_PACKET_OBSERVERS
+static flow_t * find_sent_flow(uip_ipaddr_t *destination);
+#endif
 static ipfix_t * ipfix_for_ipflow();
+static ipfix_t * ipfix_for_stats();
 static void send_ipfix_message(int type, int compression);
+static void send_aggregate_message();
+static void send_message(void *message, int length, uip_ipaddr_t *addr);
+static void export_flows(void *ptr);
+static flow_t * first_exported_flow(flow_t *flow);
+static void dest_unreach_input(void);
 /*---------------------------------------------------------------------------*/
 PROCESS(ipflow_process, "Ip flows");
+UIP_ICMP6_HANDLER(dest_unreach_handler, ICMP6_DST_UNREACH,
+                  UIP_ICMP6_HANDLER_CODE_ANY, dest_unreach_input);
+/*---------------------------------------------------------------------------*/
+#if IPFLOW_WITH_TRAFFIC_HINTS
+struct nexthop_rate {
+  linkaddr_t addr;
+  uint32_t bytes;  // sent during the current window
+  uint32_t rate;   // bytes per second, moving average
+};
+static struct nexthop_rate nexthop_rates[IPFLOW_HINT_NEIGHBORS];
+static struct ctimer hint_timer;
+/*---------------------------------------------------------------------------*/
+static void
+account_nexthop(const linkaddr_t *addr, uint16_t length)
+{
+  struct nexthop_rate *entry = NULL;
+  int i = 0;
+
+  if(linkaddr_cmp(addr, &linkaddr_null)){
+    return;
+  }
+  for(i = 0; i < IPFLOW_HINT_NEIGHBORS; i++){
+    if(linkaddr_cmp(addr, &(nexthop_rates[i].addr))){
+      entry = &nexthop_rates[i];
+      break;
+    }
+    // Otherwise take over the quietest neighbor
+    if(entry == NULL || nexthop_rates[i].rate + nexthop_rates[i].bytes <
+       entry -> rate + entry -> bytes){
+      entry = &nexthop_rates[i];
+    }
+  }
+
+  if(!linkaddr_cmp(addr, &(entry -> addr))){
+    linkaddr_copy(&(entry -> addr), addr);
+    entry -> bytes = 0;
+    entry -> rate = 0;
+  }
+  entry -> bytes = (entry -> bytes) + length;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hint_window(void *ptr)
+{
+  int i = 0;
+  for(i = 0; i < IPFLOW_HINT_NEIGHBORS; i++){
+    nexthop_rates[i].rate = (nexthop_rates[i].rate +
+      nexthop_rates[i].bytes / IPFLOW_HINT_WINDOW) / 2;
+    nexthop_rates[i].bytes = 0;
+  }
+  ctimer_reset(&hint_timer);
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+hint_rate(const linkaddr_t *nexthop)
+{
+  int i = 0;
+  for(i = 0; i < IPFLOW_HINT_NEIGHBORS; i++){
+    if(linkaddr_cmp(nexthop, &(nexthop_rates[i].addr))){
+      return nexthop_rates[i].rate;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+hint_total_rate()
+{
+  uint32_t total = 0;
+  int i = 0;
+  for(i = 0; i < IPFLOW_HINT_NEIGHBORS; i++){
+    total = total + nexthop_rates[i].rate;
+  }
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+static const struct traffic_hints_provider hints_provider = {
+  hint_rate,
+  hint_total_rate
+};
+#endif /* IPFLOW_WITH_TRAFFIC_HINTS */
+/*---------------------------------------------------------------------------*/
+#if UIP_PACKET_OBSERVERS
+static void
+observe_packet(int tap, const struct uip_packet_view *view)
+{
+#if IPFLOW_WITH_TRAFFIC_HINTS
+  if(tap == UIP_PACKET_OBSERVER_LINK && view -> link_dst != NULL){
+    account_nexthop((const linkaddr_t *)view -> link_dst, view -> link_len);
+  }
+#endif /* IPFLOW_WITH_TRAFFIC_HINTS */
+
+  if(tap == UIP_PACKET_OBSERVER_EGRESS){
+    int scale = 1;
+    uint32_t size;
+    if(sampling_rate > 1){
+      if(random_rand() % sampling_rate != 0){
+        return;
+      }
+      // 1 out of N packets, scale up to estimate the real counters
+      scale = sampling_rate;
+    }
+    size = (uint32_t)(view -> len) * scale;
+    update_flow_table((uip_ipaddr_t *)view -> destipaddr,
+                      size > 0xffff ? 0xffff : size, scale);
+#if IPFLOW_AGGREGATE_LEVELS
+    if(get_process_status() == 1 &&
+       !ipflow_aggregate_update(view -> destipaddr, view -> proto,
+                                (uint32_t)(view -> len) * scale, scale)){
+      stats.aggregate_overflows++;
+    }
+#endif /* IPFLOW_AGGREGATE_LEVELS */
+  }
+  else if(tap == UIP_PACKET_OBSERVER_LINK && get_process_status() == 1 &&
+          uip_ds6_is_my_addr((uip_ipaddr_t *)view -> srcipaddr)){
+    // Flow was created on egress, only add what it cost on air
+    flow_t *flow = find_sent_flow((uip_ipaddr_t *)view -> destipaddr);
+    if(flow != NULL){
+      flow -> onair_size = (flow -> onair_size) + (view -> link_len);
+      flow -> fragments = (flow -> fragments) + (view -> fragments);
+    }
+  }
+  else if(tap == UIP_PACKET_OBSERVER_MAC && get_process_status() == 1 &&
+          uip_ds6_is_my_addr((uip_ipaddr_t *)view -> srcipaddr)){
+    flow_t *flow = find_sent_flow((uip_ipaddr_t *)view -> destipaddr);
+    if(flow != NULL){
+      if(view -> mac_transmissions > 1){
+        flow -> retransmissions = (flow -> retransmissions) +
+          (view -> mac_transmissions) - 1;
+      }
+      if(view -> mac_status != MAC_TX_OK && view -> mac_status != MAC_TX_DEFERRED){
+        // Collision, no ACK or error after the last attempt
+        flow -> drops = (flow -> drops) + 1;
+      }
+    }
+  }
+}
+#endif
 /*---------------------------------------------------------------------------*/
 void
 launch_ipflow(int compression_mode, int role_mode)
@@ -48,20 +240,37 @@ launch_ipflow(int compression_mode, int role_mode)
   compression = compression_mode;
   role = role_mode;
 
+#if UIP_PACKET_OBSERVERS
+  uip_packet_observer_add(&observer, observe_packet);
+#else
+  printf("ipflow: no packet observers, set UIP_CONF_PACKET_OBSERVERS to meter traffic\n");
+#endif
+
   process_start(&ipflow_process, NULL);
 }
 /*---------------------------------------------------------------------------*/
 static void
 initialize()
 {
-  list_init(LIST_FLOWS_NAME);
+  list_init(flow_table_a);
+  list_init(flow_table_b);
+  live_table = flow_table_a;
+  snapshot_table = NULL;
   memb_init(&MEMB_FLOWS_NAME);
 
-  uip_ip6addr(&collector_addr, 0xaaaa, 0, 0, 0, 0, 0, 0, 1);
+  uip_ipaddr_t default_collector;
+  uip_ip6addr(&default_collector, 0xaaaa, 0, 0, 0, 0, 0, 0, 1);
+  set_collector_addr(&default_collector);
+  uip_icmp6_register_input_handler(&dest_unreach_handler);
 
   temp_flow = NULL;
 
   ipflow_ipfix = ipfix_for_ipflow();
+#if IPFLOW_AGGREGATE_LEVELS
+  ipflow_aggregate_init();
+#endif
+  stats_ipfix = ipfix_for_stats();
+  memset(&stats, 0, sizeof(stats));
 
   initialize_tipfix();
 }
@@ -69,7 +278,214 @@ initialize()
 void
 set_collector_addr(uip_ipaddr_t *addr)
 {
-  collector_addr = *addr;
+  number_collectors = 0;
+  add_collector_addr(addr);
+}
+/*---------------------------------------------------------------------------*/
+int
+add_collector_addr(uip_ipaddr_t *addr)
+{
+  if(number_collectors >= IPFLOW_MAX_COLLECTORS){
+    return 0;
+  }
+  collectors[number_collectors] = *addr;
+  collectors_failed_at[number_collectors] = 0;
+  number_collectors++;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+set_collectors_mode(int mode)
+{
+  collectors_mode = mode;
+}
+/*---------------------------------------------------------------------------*/
+#if IPFLOW_WITH_FILE || IPFLOW_WITH_TCP
+static int
+is_collector(uip_ipaddr_t *addr)
+{
+  int i = 0;
+  for(i = 0; i < number_collectors; i++){
+    if(cmp_ipaddr(addr, &collectors[i])){
+      return 1;
+    }
+  }
+  return 0;
+}
+#endif /* IPFLOW_WITH_FILE || IPFLOW_WITH_TCP */
+/*---------------------------------------------------------------------------*/
+static int
+is_collector_healthy(int i)
+{
+  if(collectors_failed_at[i] != 0 &&
+     clock_seconds() - collectors_failed_at[i] < IPFLOW_COLLECTOR_RETRY){
+    return 0;
+  }
+  collectors_failed_at[i] = 0;
+
+#ifdef UIP_FALLBACK_INTERFACE
+  // Whatever we have no route for leaves through the fallback interface
+  return 1;
+#else
+  return uip_ds6_is_addr_onlink(&collectors[i]) ||
+    uip_ds6_route_lookup(&collectors[i]) != NULL ||
+    uip_ds6_defrt_choose() != NULL;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+uip_ipaddr_t *
+get_collector_addr(uint32_t domain_id)
+{
+  int first = 0;
+  if(collectors_mode == IPFLOW_COLLECTORS_SHARDING){
+    first = domain_id % number_collectors;
+  }
+
+  // Preferred collector first, then the next ones in turn
+  int i = 0;
+  for(i = 0; i < number_collectors; i++){
+    int candidate = (first + i) % number_collectors;
+    if(is_collector_healthy(candidate)){
+      return &collectors[candidate];
+    }
+  }
+  return &collectors[first];
+}
+/*---------------------------------------------------------------------------*/
+static void
+dest_unreach_input(void)
+{
+  // The invoking packet follows the ICMPv6 header and the unused field
+  struct uip_ip_hdr *invoking = (struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN +
+    UIP_IPH_LEN + uip_ext_len + UIP_ICMPH_LEN + UIP_ICMP6_ERROR_LEN];
+  int matched = 0;
+
+  if(uip_len >= UIP_IPH_LEN + uip_ext_len + UIP_ICMPH_LEN +
+     UIP_ICMP6_ERROR_LEN + UIP_IPH_LEN){
+    int i = 0;
+    for(i = 0; i < number_collectors; i++){
+      if(cmp_ipaddr(&(invoking -> destipaddr), &collectors[i])){
+        printf("Collector unreachable, failing over\n");
+        collectors_failed_at[i] = clock_seconds();
+        // 0 means healthy
+        if(collectors_failed_at[i] == 0){
+          collectors_failed_at[i] = 1;
+        }
+        matched = 1;
+      }
+    }
+  }
+
+  if(matched){
+    uip_len = 0;
+    return;
+  }
+
+  // Not about our exports, hand it to whoever registered after us
+  uip_icmp6_input_handler_t *handler = list_item_next(&dest_unreach_handler);
+  for(; handler != NULL; handler = list_item_next(handler)){
+    if(handler -> type == ICMP6_DST_UNREACH && handler -> handler != NULL &&
+       (handler -> icode == UIP_ICMP6_HANDLER_CODE_ANY ||
+        handler -> icode == UIP_ICMP_BUF -> icode)){
+      handler -> handler();
+      return;
+    }
+  }
+  // Nobody else wants it, drop it as the stack does for unhandled messages
+  uip_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+set_export_transport(int transport_mode)
+{
+  transport = transport_mode;
+}
+/*---------------------------------------------------------------------------*/
+void
+set_delta_reporting(int enable)
+{
+  delta_reporting = enable;
+  exports_since_refresh = 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+get_upstream_addr(uip_ipaddr_t *addr)
+{
+#if UIP_CONF_IPV6_RPL
+  rpl_dag_t *dag = rpl_get_any_dag();
+  if(role == RPL_AGGREGATOR && dag != NULL && dag->preferred_parent != NULL){
+    uip_ipaddr_t *parent_addr = rpl_get_parent_ipaddr(dag->preferred_parent);
+    if(parent_addr != NULL){
+      *addr = *parent_addr;
+      return 1;
+    }
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+
+  // No parent (DAG root or not joined yet), report to the collector
+  *addr = *get_collector_addr(IPFIX_DOMAIN_ID);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+get_rpl_depth()
+{
+#if UIP_CONF_IPV6_RPL
+  rpl_dag_t *dag = rpl_get_any_dag();
+  if(dag != NULL && dag->instance != NULL && dag->instance->min_hoprankinc != 0){
+    return dag->rank / dag->instance->min_hoprankinc;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+get_export_slot()
+{
+  if(node_id != 0){
+    return node_id % IPFLOW_EXPORT_SLOTS;
+  }
+
+  // No node id on this platform, hash the link-layer address instead
+  uint16_t hash = 0;
+  int i = 0;
+  for(i = 0; i < LINKADDR_SIZE; i++){
+    hash = (hash << 5) + hash + linkaddr_node_addr.u8[i];
+  }
+  return hash % IPFLOW_EXPORT_SLOTS;
+}
+/*---------------------------------------------------------------------------*/
+int
+get_export_tier()
+{
+  if(role == AGGREGATOR){
+    return 1;
+  }
+  if(role == RPL_AGGREGATOR){
+    int depth = get_rpl_depth();
+    if(depth > IPFLOW_MAX_DEPTH){
+      depth = IPFLOW_MAX_DEPTH;
+    }
+    // Deepest nodes go first, the root last
+    return IPFLOW_MAX_DEPTH - depth;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+get_export_offset(int tier, int slot)
+{
+  return tier * IPFLOW_TIER_LENGTH + slot * IPFLOW_SLOT_LENGTH;
+}
+/*---------------------------------------------------------------------------*/
+static clock_time_t
+export_delay()
+{
+  clock_time_t delay = get_export_offset(get_export_tier(), get_export_slot());
+  if(IPFLOW_EXPORT_JITTER > 0){
+    delay = delay + (random_rand() % IPFLOW_EXPORT_JITTER);
+  }
+  return delay;
 }
 /*---------------------------------------------------------------------------*/
 static int
@@ -88,40 +504,102 @@ static flow_t *
 create_flow(uip_ipaddr_t *destination, uint16_t size, uint16_t packets)
 {
   flow_t *new_flow = memb_alloc(&MEMB_FLOWS_NAME);
+  if(new_flow == NULL){
+    return NULL;
+  }
   memcpy(&(new_flow -> destination), destination, 16*sizeof(uint8_t));
   new_flow -> size = size;
   new_flow -> packets = packets;
+  new_flow -> onair_size = 0;
+  new_flow -> fragments = 0;
+  new_flow -> retransmissions = 0;
+  new_flow -> drops = 0;
+  new_flow -> start = clock_time();
+  new_flow -> end = new_flow -> start;
+  new_flow -> start_seconds = clock_seconds();
+  new_flow -> end_seconds = new_flow -> start_seconds;
+  new_flow -> active = 1;
 
   return new_flow;
 }
 /*---------------------------------------------------------------------------*/
+static flow_t *
+find_flow_in(list_t table, uip_ipaddr_t *destination)
+{
+  stats.lookups++;
+  flow_t *current_flow;
+  for(current_flow = list_head(table);
+      current_flow != NULL;
+      current_flow = list_item_next(current_flow)) {
+    stats.lookup_steps++;
+    if (cmp_ipaddr(destination, &(current_flow -> destination)) == 1){
+      return current_flow;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static flow_t *
+find_flow(uip_ipaddr_t *destination)
+{
+  return find_flow_in(live_table, destination);
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_PACKET_OBSERVERS
+static flow_t *
+find_sent_flow(uip_ipaddr_t *destination)
+{
+  flow_t *flow = find_flow(destination);
+  if(flow == NULL && snapshot_table != NULL){
+    // Queued before the export swapped the tables, still in the snapshot
+    flow = find_flow_in(snapshot_table, destination);
+  }
+  return flow;
+}
+#endif /* UIP_PACKET_OBSERVERS */
+/*---------------------------------------------------------------------------*/
 int
 update_flow_table(uip_ipaddr_t *destination, uint16_t size, uint16_t packets)
 {
   if(get_process_status() != 1){
     return 0;
   }
+  stats.packets_seen++;
 
   // Try to update existent flow
-  flow_t *current_flow;
-  for(current_flow = list_head(LIST_FLOWS_NAME);
-      current_flow != NULL;
-      current_flow = list_item_next(current_flow)) {
-    if (cmp_ipaddr(destination, &(current_flow -> destination)) == 1){
-      current_flow -> size = size + (current_flow -> size);
-      current_flow -> packets = (current_flow -> packets) + 1;
-      return 1;
+  flow_t *current_flow = find_flow(destination);
+  if(current_flow != NULL){
+    stats.packets_accounted++;
+    current_flow -> end = clock_time();
+    current_flow -> end_seconds = clock_seconds();
+    if(current_flow -> packets == 0){
+      // First packet since the last delta export
+      current_flow -> start = current_flow -> end;
+      current_flow -> start_seconds = current_flow -> end_seconds;
     }
+    current_flow -> size = size + (current_flow -> size);
+    current_flow -> packets = (current_flow -> packets) + packets;
+    current_flow -> active = 1;
+    return 1;
   }
 
   // Check if reached maximum size table
   if (get_number_flows() >= MAX_FLOWS){
     printf("Reached maximum flows\n");
+    stats.overflows++;
     return 0;
   }
 
   flow_t *new_flow = create_flow(destination, size, packets);
-  list_push(LIST_FLOWS_NAME, new_flow);
+  if(new_flow == NULL){
+    stats.overflows++;
+    return 0;
+  }
+  list_push(live_table, new_flow);
+  stats.packets_accounted++;
+  if(get_number_flows() > stats.max_flows){
+    stats.max_flows = get_number_flows();
+  }
   return 1;
 }
 /*---------------------------------------------------------------------------*/
@@ -131,7 +609,144 @@ get_number_flows()
   if(get_process_status() != 1){
     return 0;
   }
-  return list_length(LIST_FLOWS_NAME);
+  return list_length(live_table);
+}
+static int
+is_full_refresh()
+{
+  return !delta_reporting || exports_since_refresh + 1 >= IPFLOW_FULL_REFRESH;
+}
+/*---------------------------------------------------------------------------*/
+static flow_t *
+first_exported_flow(flow_t *flow)
+{
+  if(is_full_refresh()){
+    return flow;
+  }
+  while(flow != NULL && flow -> packets == 0){
+    flow = flow -> next;
+  }
+  return flow;
+}
+/*---------------------------------------------------------------------------*/
+int
+get_number_exported_flows()
+{
+  if(get_process_status() != 1){
+    return 0;
+  }
+
+  // During an export, count what is being encoded
+  list_t table = snapshot_table != NULL ? snapshot_table : live_table;
+  int n = 0;
+  flow_t *current_flow;
+  for(current_flow = first_exported_flow(list_head(table));
+      current_flow != NULL;
+      current_flow = first_exported_flow(current_flow -> next)) {
+    n++;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+// Flow records that fit one message: within the uIP buffer and, for
+// TinyIPFIX, within the one byte length field. A full table leaves in
+// several messages.
+static int
+records_per_message()
+{
+  int budget;
+  if(compression == NO_COMPRESSION){
+    budget = UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN -
+      IPFIX_HEADER_LENGTH - IPFIX_SET_HEADER_LENGTH;
+  }
+  else{
+    budget = IPFLOW_MAX_AGGREGATE_LENGTH - TIPFIX_HEADER_LENGTH;
+  }
+  return budget < IPFLOW_RECORD_LENGTH ? 1 : budget / IPFLOW_RECORD_LENGTH;
+}
+/*---------------------------------------------------------------------------*/
+// Records of the next message, from the first flow not exported yet
+static int
+records_in_message()
+{
+  int max = records_per_message();
+  int n = 0;
+  flow_t *current_flow;
+  for(current_flow = temp_flow;
+      current_flow != NULL && n < max;
+      current_flow = first_exported_flow(current_flow -> next)) {
+    n++;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_of_export()
+{
+  snapshot_table = live_table;
+  live_table = (live_table == flow_table_a) ? flow_table_b : flow_table_a;
+}
+/*---------------------------------------------------------------------------*/
+static void
+keep_flow(flow_t *flow)
+{
+  flow_t *live_flow = find_flow(&(flow -> destination));
+  if(live_flow != NULL){
+    // Already seen again during the export, the live entry is newer
+    if(flow -> active || live_flow -> packets != 0){
+      live_flow -> active = 1;
+    }
+    memb_free(&MEMB_FLOWS_NAME, flow);
+  }
+  else if(get_number_flows() >= MAX_FLOWS){
+    memb_free(&MEMB_FLOWS_NAME, flow);
+    stats.evictions++;
+  }
+  else{
+    list_add(live_table, flow);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+end_of_export()
+{
+  flow_t *current_flow;
+
+  if(!delta_reporting){
+    for(current_flow = list_pop(snapshot_table);
+        current_flow != NULL;
+        current_flow = list_pop(snapshot_table)) {
+      memb_free(&MEMB_FLOWS_NAME, current_flow);
+    }
+    snapshot_table = NULL;
+    return;
+  }
+
+  int refresh = is_full_refresh();
+  for(current_flow = list_pop(snapshot_table);
+      current_flow != NULL;
+      current_flow = list_pop(snapshot_table)) {
+    if(refresh && current_flow -> active == 0){
+      // Idle during a whole refresh period, the collector no longer sees it
+      memb_free(&MEMB_FLOWS_NAME, current_flow);
+      stats.evictions++;
+    }
+    else{
+      current_flow -> size = 0;
+      current_flow -> packets = 0;
+      current_flow -> onair_size = 0;
+      current_flow -> fragments = 0;
+      current_flow -> retransmissions = 0;
+      current_flow -> drops = 0;
+      if(refresh){
+        current_flow -> active = 0;
+      }
+      // Back in the live table for the next interval
+      keep_flow(current_flow);
+    }
+  }
+  snapshot_table = NULL;
+  exports_since_refresh = refresh ? 0 : exports_since_refresh + 1;
 }
 /*---------------------------------------------------------------------------*/
 int
@@ -148,13 +763,62 @@ flush_flow_table()
   }
 
   flow_t *current_flow;
-  for(current_flow = list_pop(LIST_FLOWS_NAME);
+  for(current_flow = list_pop(live_table);
      current_flow != NULL;
-     current_flow = list_pop(LIST_FLOWS_NAME)) {
+     current_flow = list_pop(live_table)) {
     memb_free(&MEMB_FLOWS_NAME, current_flow);
   }
 }
 /*---------------------------------------------------------------------------*/
+flow_t *
+get_flow_table_head()
+{
+  if(get_process_status() != 1){
+    return NULL;
+  }
+  return list_head(live_table);
+}
+/*---------------------------------------------------------------------------*/
+void
+set_sampling_rate(int rate)
+{
+  sampling_rate = rate < 1 ? 1 : rate;
+}
+/*---------------------------------------------------------------------------*/
+int
+get_sampling_rate()
+{
+  return sampling_rate;
+}
+/*---------------------------------------------------------------------------*/
+int
+set_export_interval(int minutes)
+{
+  if(minutes < 1 || (clock_time_t)minutes > IPFLOW_MAX_EXPORT_INTERVAL){
+    return 0;
+  }
+  export_interval = minutes;
+  if(get_process_status() == 1){
+    // Restart the interval now, the timer belongs to the ipflow process
+    PROCESS_CONTEXT_BEGIN(&ipflow_process);
+    etimer_set(&periodic, (clock_time_t)export_interval * 60 * CLOCK_SECOND);
+    PROCESS_CONTEXT_END(&ipflow_process);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+get_export_interval()
+{
+  return export_interval;
+}
+/*---------------------------------------------------------------------------*/
+const ipflow_stats_t *
+get_ipflow_stats()
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
 uint8_t *
 get_octet_delta_count()
 {
@@ -168,6 +832,70 @@ get_packet_delta_count()
 }
 /*---------------------------------------------------------------------------*/
 uint8_t *
+get_onair_octet_count()
+{
+  return (uint8_t *)&(temp_flow -> onair_size);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_fragment_count()
+{
+  return (uint8_t *)&(temp_flow -> fragments);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_retransmission_count()
+{
+  return (uint8_t *)&(temp_flow -> retransmissions);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_drop_count()
+{
+  return (uint8_t *)&(temp_flow -> drops);
+}
+/*---------------------------------------------------------------------------*/
+// Largest delta the 32-bit field can carry, about 71 minutes
+#define MAX_DELTA_SECONDS (0xffffffffUL / 1000000UL)
+
+static uint32_t
+delta_microseconds(clock_time_t time, unsigned long seconds)
+{
+  unsigned long elapsed = clock_seconds() - seconds;
+  uint32_t ticks;
+
+  if(elapsed >= MAX_DELTA_SECONDS){
+    return 0xffffffff;
+  }
+  if(elapsed >= (clock_time_t)~0 / CLOCK_SECOND / 2){
+    // clock_time() may have wrapped since, whole seconds only
+    return elapsed * 1000000UL;
+  }
+  ticks = (clock_time_t)(clock_time() - time);
+  if(ticks / CLOCK_SECOND >= MAX_DELTA_SECONDS){
+    return 0xffffffff;
+  }
+  return (ticks / CLOCK_SECOND) * 1000000UL +
+    (ticks % CLOCK_SECOND) * 1000000UL / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_flow_start_delta()
+{
+  static uint32_t delta = 0;
+  delta = delta_microseconds(temp_flow -> start, temp_flow -> start_seconds);
+  return (uint8_t *)&delta;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_flow_end_delta()
+{
+  static uint32_t delta = 0;
+  delta = delta_microseconds(temp_flow -> end, temp_flow -> end_seconds);
+  return (uint8_t *)&delta;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
 get_source_node_id()
 {
   return (uint8_t *)&node_id;
@@ -177,21 +905,120 @@ uint8_t *
 get_destination_node_id()
 {
   flow_t *flow = temp_flow;
-  temp_flow = temp_flow -> next;
+  temp_flow = first_exported_flow(temp_flow -> next);
   static uint16_t temp = 0;
   temp = (flow -> destination).u16[7];
   temp = UIP_HTONS(temp);
   return (uint8_t *)&temp;
 }
 /*---------------------------------------------------------------------------*/
+uint8_t *
+get_observation_domain_id()
+{
+  static uint32_t domain_id = 0;
+  domain_id = IPFIX_DOMAIN_ID;
+  return (uint8_t *)&domain_id;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_max_flows_count()
+{
+  return (uint8_t *)&(stats.max_flows);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_eviction_count()
+{
+  return (uint8_t *)&(stats.evictions);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_overflow_count()
+{
+  return (uint8_t *)&(stats.overflows);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_packets_seen_count()
+{
+  return (uint8_t *)&(stats.packets_seen);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_packets_accounted_count()
+{
+  return (uint8_t *)&(stats.packets_accounted);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_exported_message_count()
+{
+  return (uint8_t *)&(stats.messages);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_exported_octet_count()
+{
+  return (uint8_t *)&(stats.octets);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_encode_ticks()
+{
+  return (uint8_t *)&(stats.encode_ticks);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t *
+get_dropped_send_count()
+{
+  return (uint8_t *)&(stats.dropped_sends);
+}
+/*---------------------------------------------------------------------------*/
+static int
+one_record()
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static ipfix_t *
+ipfix_for_stats()
+{
+  template_t *template = create_ipfix_options_template(IPFLOW_STATS_TEMPLATE_ID,
+    &one_record, 1);
+
+  // Scope first
+  add_element_to_template(template, OBSERVATION_DOMAIN_ID);
+  add_element_to_template(template, MAX_FLOWS_COUNT);
+  add_element_to_template(template, EVICTION_COUNT);
+  add_element_to_template(template, OVERFLOW_COUNT);
+  add_element_to_template(template, PACKETS_SEEN_COUNT);
+  add_element_to_template(template, PACKETS_ACCOUNTED_COUNT);
+  add_element_to_template(template, EXPORTED_MESSAGE_TOTAL_COUNT);
+  add_element_to_template(template, EXPORTED_OCTET_TOTAL_COUNT);
+  add_element_to_template(template, ENCODE_TICKS);
+  add_element_to_template(template, DROPPED_SEND_COUNT);
+
+  ipfix_t *ipfix = create_ipfix();
+  add_templates_to_ipfix(ipfix, template);
+
+  return ipfix;
+}
+/*---------------------------------------------------------------------------*/
 static ipfix_t *
 ipfix_for_ipflow()
 {
-  template_t *template = create_ipfix_template(256, &get_number_flows);
+  template_t *template = create_ipfix_template(256, &records_in_message);
 
   add_element_to_template(template, OCTET_DELTA_COUNT);
   add_element_to_template(template, PACKET_DELTA_COUNT);
   add_element_to_template(template, SOURCE_NODE_ID);
+  add_element_to_template(template, ONAIR_OCTET_COUNT);
+  add_element_to_template(template, FRAGMENT_COUNT);
+  add_element_to_template(template, RETRANSMISSION_COUNT);
+  add_element_to_template(template, DROP_COUNT);
+  add_element_to_template(template, FLOW_START_DELTA_MICROSECONDS);
+  add_element_to_template(template, FLOW_END_DELTA_MICROSECONDS);
+  // Moves on to the next flow, must stay the last element
   add_element_to_template(template, DESTINATION_NODE_ID);
 
   ipfix_t *ipfix = create_ipfix();
@@ -200,34 +1027,244 @@ ipfix_for_ipflow()
   return ipfix;
 }
 /*---------------------------------------------------------------------------*/
+#if IPFLOW_WITH_TCP
+#define TCP_DOWN 0
+#define TCP_CONNECTING 1
+#define TCP_UP 2
+
+static struct tcp_socket exporter_socket;
+static uint8_t tcp_input_buffer[8];
+static uint8_t tcp_output_buffer[IPFLOW_TCP_BUFFER_LENGTH];
+static int tcp_state = TCP_DOWN;
+static uip_ipaddr_t tcp_collector_addr;
+/*---------------------------------------------------------------------------*/
+static int
+tcp_input(struct tcp_socket *s, void *ptr, const uint8_t *input_data_ptr,
+  int input_data_len)
+{
+  // Collector does not talk back, discard
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+tcp_event(struct tcp_socket *s, void *ptr, tcp_socket_event_t event)
+{
+  if(event == TCP_SOCKET_CONNECTED){
+    printf("Connected to collector\n");
+    tcp_state = TCP_UP;
+  }
+  else if(event != TCP_SOCKET_DATA_SENT){
+    // Closed, timed out or aborted, back to UDP until we reconnect
+    tcp_state = TCP_DOWN;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+send_message_tcp(void *message, int length)
+{
+  if(tcp_state == TCP_DOWN){
+    tcp_collector_addr = *get_collector_addr(IPFIX_DOMAIN_ID);
+    if(tcp_socket_connect(&exporter_socket, &tcp_collector_addr, COLLECTOR_TCP_PORT) == 1){
+      tcp_state = TCP_CONNECTING;
+    }
+    return 0;
+  }
+  if(tcp_state != TCP_UP || tcp_socket_max_sendlen(&exporter_socket) < length){
+    // Not connected yet or collector is not keeping up
+    return 0;
+  }
+  return tcp_socket_send(&exporter_socket, message, length) == length;
+}
+#endif /* IPFLOW_WITH_TCP */
+/*---------------------------------------------------------------------------*/
+static void
+count_sent(int length)
+{
+  stats.messages++;
+  stats.octets = stats.octets + length;
+  if(length > stats.max_message){
+    stats.max_message = length;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_message(void *message, int length, uip_ipaddr_t *addr)
+{
+#if IPFLOW_WITH_FILE
+  // Keep a local copy of everything sent to the collector as IPFIX
+  if(is_collector(addr) &&
+     (role == GATEWAY || compression == NO_COMPRESSION)){
+    ipflow_file_write(message, length);
+  }
+#endif /* IPFLOW_WITH_FILE */
+
+#if IPFLOW_WITH_TCP
+  // Only IPFIX messages have a header that frames them on a stream
+  if(transport == IPFLOW_TRANSPORT_TCP &&
+     (tcp_state == TCP_DOWN || cmp_ipaddr(addr, &tcp_collector_addr)) &&
+     is_collector(addr) &&
+     (role == GATEWAY || compression == NO_COMPRESSION)){
+    if(send_message_tcp(message, length)){
+      count_sent(length);
+      return;
+    }
+  }
+#endif /* IPFLOW_WITH_TCP */
+
+  if(length > UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN){
+    // Would be truncated, the collector could not parse it anyway
+    stats.dropped_sends++;
+    return;
+  }
+
+  uip_udp_packet_sendto(exporter_connection, message, length * sizeof(uint8_t),
+                        addr, UIP_HTONS(COLLECTOR_UDP_PORT));
+  count_sent(length);
+}
+/*---------------------------------------------------------------------------*/
+static void
+encode_done(rtimer_clock_t start)
+{
+  rtimer_clock_t ticks = RTIMER_NOW() - start;
+  if(ticks > stats.encode_ticks){
+    stats.encode_ticks = ticks;
+  }
+}
+/*---------------------------------------------------------------------------*/
 static void
 send_ipfix_message(int type, int compression)
 {
-  uint8_t message[200];
   int length;
+  uip_ipaddr_t upstream_addr;
+  rtimer_clock_t start = RTIMER_NOW();
   if(compression == NO_COMPRESSION){
-    length = generate_ipfix_message(message, ipflow_ipfix, type);
+    length = generate_ipfix_message(export_buffer, ipflow_ipfix, type);
   }
   else{
-    length = generate_tipfix_message(message, ipflow_ipfix, type);
+    length = generate_tipfix_message(export_buffer, ipflow_ipfix, type);
   }
+  encode_done(start);
+
+  get_upstream_addr(&upstream_addr);
+  send_message(export_buffer, length, &upstream_addr);
+}
+/*---------------------------------------------------------------------------*/
+// Options and aggregate records are plain IPFIX. Only send them where
+// our upstream is the collector itself: a TinyIPFIX gateway or aggregator
+// would convert or merge them as flow records.
+static int
+upstream_is_ipfix()
+{
+  return role == GATEWAY || (role == STANDARD && compression == NO_COMPRESSION);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_stats()
+{
+  int length;
+
+  stats_due = 0;
+  if(!upstream_is_ipfix()){
+    return;
+  }
+
+  // Options template goes along, the collector may have missed the last one
+  length = generate_ipfix_message(export_buffer, stats_ipfix, IPFIX_TEMPLATE);
+  send_message(export_buffer, length, get_collector_addr(IPFIX_DOMAIN_ID));
+  length = generate_ipfix_message(export_buffer, stats_ipfix, IPFIX_DATA);
+  send_message(export_buffer, length, get_collector_addr(IPFIX_DOMAIN_ID));
+}
+/*---------------------------------------------------------------------------*/
+#if IPFLOW_AGGREGATE_LEVELS
+#if IPFLOW_AGGREGATE_MESSAGE_LENGTH > IPFLOW_MESSAGE_LENGTH
+#error "IPFLOW_CONF_AGGREGATE_ENTRIES too large for the export buffer"
+#endif
+static void
+send_aggregates()
+{
+  static int exports = 0;
+  int level;
+  int length;
+  ipfix_t *ipfix;
 
-  uip_udp_packet_sendto(exporter_connection, &message, length * sizeof(uint8_t),
-                        &collector_addr, UIP_HTONS(COLLECTOR_UDP_PORT));
+  // One message per level, all levels would not fit the uIP buffer
+  for(level = IPFLOW_LEVEL_PREFIX; level <= IPFLOW_LEVEL_PROTOCOL; level <<= 1){
+    ipfix = ipflow_aggregate_ipfix(level);
+    if(ipfix == NULL){
+      continue;
+    }
+    if(!upstream_is_ipfix()){
+      ipflow_aggregate_flush(level);
+      continue;
+    }
+    if(exports == 0){
+      length = generate_ipfix_message(export_buffer, ipfix, IPFIX_TEMPLATE);
+      send_message(export_buffer, length, get_collector_addr(IPFIX_DOMAIN_ID));
+    }
+
+    rtimer_clock_t start = RTIMER_NOW();
+    length = generate_ipfix_message(export_buffer, ipfix, IPFIX_DATA);
+    encode_done(start);
+    // Reset before sending, the message itself counts in the next interval
+    ipflow_aggregate_flush(level);
+    send_message(export_buffer, length, get_collector_addr(IPFIX_DOMAIN_ID));
+  }
+  exports = (exports + 1) % IPFLOW_FULL_REFRESH;
 }
+#endif /* IPFLOW_AGGREGATE_LEVELS */
 /*---------------------------------------------------------------------------*/
 static char aggrega[500];
 static int length_aggrega = 0;
 static int received = 0;
+// RPL_AGGREGATOR: reports from children this period and the previous one
+static int child_reports = 0;
+static int expected_reports = 0;
+static int holding = 0;
+static struct ctimer hold_timer;
+/*---------------------------------------------------------------------------*/
+static int
+is_template_message(char *msg)
+{
+  return (((uint8_t)msg[0]) >> 2) == 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_aggregate_message()
+{
+  uip_ipaddr_t upstream_addr;
+
+  if(length_aggrega == 0){
+    return;
+  }
+  get_upstream_addr(&upstream_addr);
+  send_message(aggrega, length_aggrega, &upstream_addr);
+  length_aggrega = 0;
+  received = 0;
+}
 /*---------------------------------------------------------------------------*/
 static void
 update_aggregate_message(char *msg, int length) {
+  if(length < TIPFIX_HEADER_LENGTH || length > IPFLOW_MAX_AGGREGATE_LENGTH){
+    // Not a TinyIPFIX message that can be merged
+    stats.dropped_sends++;
+    return;
+  }
+  // Every node shares the same template, the root gets it from its children
+  if(role == RPL_AGGREGATOR && is_template_message(msg)){
+    return;
+  }
+  // Merged report would not fit, push what we have upstream first
+  if(length_aggrega != 0 &&
+     length_aggrega + length - TIPFIX_HEADER_LENGTH > IPFLOW_MAX_AGGREGATE_LENGTH){
+    send_aggregate_message();
+  }
+
   if(length_aggrega == 0){
     memcpy(aggrega, msg, sizeof(char)*length);
     length_aggrega = length_aggrega + length;
   }
   else{
-    char cpy[500];
+    char cpy[IPFLOW_MAX_AGGREGATE_LENGTH];
     memcpy(cpy, aggrega, sizeof(char)*length_aggrega);
     length_aggrega = aggregate_message((uint8_t *)cpy, (uint8_t *)msg,
      (uint8_t *)aggrega);
@@ -235,9 +1272,80 @@ update_aggregate_message(char *msg, int length) {
   received++;
 }
 /*---------------------------------------------------------------------------*/
+static void
+export_flows(void *ptr)
+{
+  if(role == RPL_AGGREGATOR){
+    ctimer_stop(&hold_timer);
+    holding = 0;
+    expected_reports = child_reports;
+    child_reports = 0;
+  }
+
+  start_of_export();
+  temp_flow = first_exported_flow(list_head(snapshot_table));
+
+  // Each pass encodes as many records as fit a message, from temp_flow
+  if(role == AGGREGATOR || role == RPL_AGGREGATOR){
+    printf(role == AGGREGATOR ? "Sent aggregate data\n" : "Sent subtree data\n");
+    do{
+      rtimer_clock_t start = RTIMER_NOW();
+      int length = generate_tipfix_message(export_buffer, ipflow_ipfix, IPFIX_DATA);
+      encode_done(start);
+      update_aggregate_message((char *)export_buffer, length);
+    } while(temp_flow != NULL);
+    send_aggregate_message();
+  }
+  else if(role == STANDARD){
+    printf("Sent data\n");
+    do{
+      send_ipfix_message(IPFIX_DATA, compression);
+    } while(temp_flow != NULL);
+  }
+  end_of_export();
+
+#if IPFLOW_AGGREGATE_LEVELS
+  send_aggregates();
+#endif
+
+  if(stats_due){
+    send_stats();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+scheduled_export(void *ptr)
+{
+  // Children that reported last period may still be on their way
+  if(role == RPL_AGGREGATOR && IPFLOW_CHILD_WAIT > 0 &&
+     child_reports < expected_reports){
+    printf("Waiting for %d subtree reports\n", expected_reports - child_reports);
+    holding = 1;
+    ctimer_set(&hold_timer, IPFLOW_CHILD_WAIT, export_flows, NULL);
+    return;
+  }
+  export_flows(ptr);
+}
+/*---------------------------------------------------------------------------*/
+void
+export_now()
+{
+  if(get_process_status() != 1 || role == GATEWAY){
+    return;
+  }
+  export_flows(NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_template(void *ptr)
+{
+  send_ipfix_message(IPFIX_TEMPLATE, compression);
+}
+/*---------------------------------------------------------------------------*/
 PROCESS_THREAD(ipflow_process, ev, data)
 {
-  static struct etimer periodic;
+  static struct ctimer export_timer;
+  static int intervals = 0;
 
   PROCESS_BEGIN();
 
@@ -249,27 +1357,47 @@ PROCESS_THREAD(ipflow_process, ev, data)
   }
   udp_bind(exporter_connection, UIP_HTONS(COLLECTOR_UDP_PORT));
 
+#if IPFLOW_WITH_FILE
+  ipflow_file_init();
+#endif
+
+#if IPFLOW_WITH_TRAFFIC_HINTS
+  memset(nexthop_rates, 0, sizeof(nexthop_rates));
+  ctimer_set(&hint_timer, IPFLOW_HINT_WINDOW * CLOCK_SECOND, hint_window, NULL);
+  traffic_hints_register(&hints_provider);
+#endif
+
+#if IPFLOW_WITH_TCP
+  tcp_socket_register(&exporter_socket, NULL,
+                      tcp_input_buffer, sizeof(tcp_input_buffer),
+                      tcp_output_buffer, sizeof(tcp_output_buffer),
+                      tcp_input, tcp_event);
+#endif
+
   PROCESS_PAUSE();
   if(role != GATEWAY){
-    // Send template
-    if (role == AGGREGATOR) {
-      etimer_set(&periodic, IPFLOW_EXPORT_INTERVAL*30*CLOCK_SECOND);
-    }
-    else if (role == STANDARD) {
-      etimer_set(&periodic, IPFLOW_EXPORT_INTERVAL*20*CLOCK_SECOND);
-    }
+    // Send template in our slot, after the network had time to form
+    etimer_set(&periodic, (clock_time_t)IPFLOW_EXPORT_INTERVAL * 20 * CLOCK_SECOND);
     PROCESS_YIELD_UNTIL(etimer_expired(&periodic));
-    send_ipfix_message(IPFIX_TEMPLATE, compression);
+    ctimer_set(&export_timer, export_delay(), send_template, NULL);
   }
 
   // Send data
-  etimer_set(&periodic, IPFLOW_EXPORT_INTERVAL*60*CLOCK_SECOND);
+  etimer_set(&periodic, (clock_time_t)export_interval * 60 * CLOCK_SECOND);
   while(1){
     PROCESS_YIELD();
-    if(role == AGGREGATOR && ev == tcpip_event) {
+    if((role == AGGREGATOR || role == RPL_AGGREGATOR) && ev == tcpip_event) {
       if(uip_newdata()) {
         printf("Received data\n");
+        if(uip_datalen() >= TIPFIX_HEADER_LENGTH &&
+           !is_template_message(uip_appdata)){
+          child_reports++;
+        }
         update_aggregate_message(uip_appdata, uip_datalen());
+        // Every child is in, no need to wait for the timeout
+        if(holding && child_reports >= expected_reports){
+          export_flows(NULL);
+        }
       }
     }
 
@@ -279,32 +1407,29 @@ PROCESS_THREAD(ipflow_process, ev, data)
         uint16_t sender_node_id = 0;
         sender_node_id = (UIP_IP_BUF->srcipaddr).u16[7];
         sender_node_id = UIP_HTONS(sender_node_id);
+        rtimer_clock_t start = RTIMER_NOW();
         int length = tipifx_to_ipfix((uint8_t *)uip_appdata,
           sender_node_id, (uint8_t *)aggrega);
+        encode_done(start);
 
-        uip_udp_packet_sendto(exporter_connection, &aggrega, length * sizeof(uint8_t),
-                              &collector_addr, UIP_HTONS(COLLECTOR_UDP_PORT));
+        send_message(aggrega, length, get_collector_addr(sender_node_id));
       }
     }
 
-    if(etimer_expired(&periodic) && role != GATEWAY) {
-      temp_flow = list_head(LIST_FLOWS_NAME);
-
-      if(role == AGGREGATOR){
-        printf("Sent aggregate data\n");
-        uint8_t message[200];
-        int length = generate_tipfix_message(message, ipflow_ipfix, compression);
-        update_aggregate_message((char *)message, length);
-        uip_udp_packet_sendto(exporter_connection, &aggrega, length_aggrega * sizeof(uint8_t),
-        &collector_addr, UIP_HTONS(COLLECTOR_UDP_PORT));
-        length_aggrega = 0;
+    if(etimer_expired(&periodic)) {
+      if(IPFLOW_STATS_INTERVAL > 0 && ++intervals >= IPFLOW_STATS_INTERVAL){
+        intervals = 0;
+        stats_due = 1;
+      }
+
+      if(role != GATEWAY){
+        // Start of a new interval, export in our own slot
+        ctimer_set(&export_timer, export_delay(), scheduled_export, NULL);
       }
-      else if(role == STANDARD){
-        printf("Sent data\n");
-        send_ipfix_message(IPFIX_DATA, compression);
+      else if(stats_due){
+        send_stats();
       }
       etimer_reset(&periodic);
-      flush_flow_table();
     }
   }
 
@@ -11,41 +11,270 @@
 #define IPFLOW_H_
 /*---------------------------------------------------------------------------*/
 #include "net/ip/uip.h"
+#include "sys/rtimer.h"
 #include "net/ipv6/tinyipfix/tipfix.h"
 /*---------------------------------------------------------------------------*/
 #define MAX_FLOWS 10
-#define IPFLOW_EXPORT_INTERVAL 1 // minute
+#define IPFLOW_EXPORT_INTERVAL 1 // minute, default for set_export_interval()
+// Longest interval the export etimer can count, in minutes
+#define IPFLOW_MAX_EXPORT_INTERVAL \
+  ((clock_time_t)~0 / (60 * (clock_time_t)CLOCK_SECOND))
 #define COLLECTOR_UDP_PORT 9995
 
+/* A data record is 24 bytes, see ipfix_for_ipflow() */
+#define IPFLOW_RECORD_LENGTH 24
+#define IPFLOW_MESSAGE_LENGTH (IPFIX_HEADER_LENGTH + IPFIX_SET_HEADER_LENGTH + \
+                               MAX_FLOWS * IPFLOW_RECORD_LENGTH)
+
 #define NO_COMPRESSION 1
 #define AGGRESSIVE 2
 
+#define IPFLOW_TRANSPORT_UDP 1
+#define IPFLOW_TRANSPORT_TCP 2
+
+/* With several collectors, FAILOVER sends everything to the first healthy
+ * collector of the list while SHARDING spreads observation domains over
+ * the collectors. A collector is unhealthy while there is no route to it
+ * or for IPFLOW_COLLECTOR_RETRY seconds after it triggered an ICMPv6
+ * destination unreachable. */
+#define IPFLOW_COLLECTORS_FAILOVER 1
+#define IPFLOW_COLLECTORS_SHARDING 2
+
+#ifdef IPFLOW_CONF_MAX_COLLECTORS
+#define IPFLOW_MAX_COLLECTORS IPFLOW_CONF_MAX_COLLECTORS
+#else
+#define IPFLOW_MAX_COLLECTORS 2
+#endif
+
+#ifdef IPFLOW_CONF_COLLECTOR_RETRY
+#define IPFLOW_COLLECTOR_RETRY IPFLOW_CONF_COLLECTOR_RETRY
+#else
+#define IPFLOW_COLLECTOR_RETRY 120 // seconds
+#endif
+
 #define STANDARD 1
 #define AGGREGATOR 2
 #define GATEWAY 3
+#define RPL_AGGREGATOR 4
+
+/* RPL_AGGREGATOR: reports go to the RPL preferred parent and are merged on
+ * the way up. Nodes export at an offset depending on their depth in the DAG
+ * (rank / min_hoprankinc), so children usually report before their parent.
+ * The tiers alone do not guarantee it: export periods are not synchronized
+ * between nodes, and a parent and child whose ranks round to the same depth
+ * share a tier. A parent therefore holds its export until it got as many
+ * reports from its children as in the previous period, for at most
+ * IPFLOW_CHILD_WAIT clock ticks. A report that still arrives after the
+ * parent exported is merged into the parent's next report. */
+#ifdef IPFLOW_CONF_MAX_DEPTH
+#define IPFLOW_MAX_DEPTH IPFLOW_CONF_MAX_DEPTH
+#else
+#define IPFLOW_MAX_DEPTH 8
+#endif
+
+#ifdef IPFLOW_CONF_CHILD_WAIT
+#define IPFLOW_CHILD_WAIT IPFLOW_CONF_CHILD_WAIT
+#else
+#define IPFLOW_CHILD_WAIT IPFLOW_TIER_LENGTH
+#endif
+
+/* Export schedule. Every export interval is cut into tiers of
+ * IPFLOW_EXPORT_SLOTS slots, each IPFLOW_SLOT_LENGTH clock ticks long.
+ * A node exports in the slot given by its node id, plus a random jitter
+ * smaller than IPFLOW_EXPORT_JITTER, so that nodes booted together do
+ * not transmit at the same time. Exporters use tier 0, aggregators tier 1
+ * and RPL_AGGREGATOR nodes the tier matching their depth (deepest first).
+ * A tier is over once all its slots are, so an aggregator can compute
+ * exactly when its children are done. */
+#ifdef IPFLOW_CONF_EXPORT_SLOTS
+#define IPFLOW_EXPORT_SLOTS IPFLOW_CONF_EXPORT_SLOTS
+#else
+#define IPFLOW_EXPORT_SLOTS 8
+#endif
+
+#ifdef IPFLOW_CONF_SLOT_LENGTH
+#define IPFLOW_SLOT_LENGTH IPFLOW_CONF_SLOT_LENGTH
+#else
+#define IPFLOW_SLOT_LENGTH (CLOCK_SECOND / 2)
+#endif
+
+#ifdef IPFLOW_CONF_EXPORT_JITTER
+#define IPFLOW_EXPORT_JITTER IPFLOW_CONF_EXPORT_JITTER
+#else
+#define IPFLOW_EXPORT_JITTER (IPFLOW_SLOT_LENGTH / 4)
+#endif
+
+/* Delta reporting: flows are kept between exports and only the ones that
+ * changed since the previous export are reported. Every
+ * IPFLOW_FULL_REFRESH exports all flows are reported, so the collector
+ * can rebuild the set of live flows, and flows idle since the previous
+ * refresh are removed. */
+#ifdef IPFLOW_CONF_FULL_REFRESH
+#define IPFLOW_FULL_REFRESH IPFLOW_CONF_FULL_REFRESH
+#else
+#define IPFLOW_FULL_REFRESH 10
+#endif
+
+/* IPFIX export to the collector over one long-lived TCP connection
+ * (tcp-socket), mainly for the border router. Messages go over UDP while
+ * the connection is down or when its output buffer cannot take them.
+ * There is a single session, to the collector of the node's own
+ * observation domain (get_collector_addr(IPFIX_DOMAIN_ID)). With
+ * IPFLOW_COLLECTORS_SHARDING, messages a gateway relays for domains
+ * sharded to other collectors always go over UDP. */
+#ifdef IPFLOW_CONF_WITH_TCP
+#define IPFLOW_WITH_TCP IPFLOW_CONF_WITH_TCP
+#else
+#define IPFLOW_WITH_TCP 0
+#endif
+
+#ifdef IPFLOW_CONF_COLLECTOR_TCP_PORT
+#define COLLECTOR_TCP_PORT IPFLOW_CONF_COLLECTOR_TCP_PORT
+#else
+#define COLLECTOR_TCP_PORT COLLECTOR_UDP_PORT
+#endif
+
+#ifdef IPFLOW_CONF_TCP_BUFFER_LENGTH
+#define IPFLOW_TCP_BUFFER_LENGTH IPFLOW_CONF_TCP_BUFFER_LENGTH
+#else
+#define IPFLOW_TCP_BUFFER_LENGTH (2 * IPFLOW_MESSAGE_LENGTH)
+#endif
+
+#define IPFLOW_TIER_LENGTH (IPFLOW_EXPORT_SLOTS * IPFLOW_SLOT_LENGTH)
+
+/* Exporter self-telemetry. Every IPFLOW_STATS_INTERVAL export intervals
+ * the meter sends its own statistics (see ipflow_stats_t) to the collector
+ * as an IPFIX options template and record, scoped by the observation
+ * domain. Only STANDARD nodes exporting without compression and gateways
+ * send them, as they talk IPFIX to the collector directly. 0 disables it. */
+#ifdef IPFLOW_CONF_STATS_INTERVAL
+#define IPFLOW_STATS_INTERVAL IPFLOW_CONF_STATS_INTERVAL
+#else
+#define IPFLOW_STATS_INTERVAL 0
+#endif
+
+#define IPFLOW_STATS_TEMPLATE_ID 257
+
+/* Traffic hints (net/traffic-hints.h): the meter measures the bytes sent
+ * to each next-hop neighbor, forwarded traffic included, and provides
+ * them as rates averaged over IPFLOW_HINT_WINDOW seconds. */
+#ifdef IPFLOW_CONF_WITH_TRAFFIC_HINTS
+#define IPFLOW_WITH_TRAFFIC_HINTS IPFLOW_CONF_WITH_TRAFFIC_HINTS
+#else
+#define IPFLOW_WITH_TRAFFIC_HINTS 0
+#endif
+
+#ifdef IPFLOW_CONF_HINT_NEIGHBORS
+#define IPFLOW_HINT_NEIGHBORS IPFLOW_CONF_HINT_NEIGHBORS
+#else
+#define IPFLOW_HINT_NEIGHBORS 4
+#endif
+
+#ifdef IPFLOW_CONF_HINT_WINDOW
+#define IPFLOW_HINT_WINDOW IPFLOW_CONF_HINT_WINDOW
+#else
+#define IPFLOW_HINT_WINDOW 10 // seconds
+#endif
+
+/* Largest TinyIPFIX message, bounded by the one byte length field used
+ * by aggregate_message() and by the uIP buffer. Aggregators send what
+ * they merged before going over it, and flow exports larger than it are
+ * split over several messages. */
+#ifdef IPFLOW_CONF_MAX_AGGREGATE_LENGTH
+#define IPFLOW_MAX_AGGREGATE_LENGTH IPFLOW_CONF_MAX_AGGREGATE_LENGTH
+#elif (UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN) < 255
+#define IPFLOW_MAX_AGGREGATE_LENGTH (UIP_BUFSIZE - UIP_LLH_LEN - UIP_IPUDPH_LEN)
+#else
+#define IPFLOW_MAX_AGGREGATE_LENGTH 255
+#endif
 /*---------------------------------------------------------------------------*/
 
 /** Structures definition **/
 typedef struct flow{
   struct flow *next;
   uip_ipaddr_t destination;
+  // With sampling, estimated from the sampled packets (see set_sampling_rate())
   uint16_t size;
   uint16_t packets;
+  // Counted for every packet of a flow once it exists, never sampled or
+  // scaled, so with sampling they do not add up with size and packets
+  uint16_t onair_size;
+  uint16_t fragments;
+  uint16_t retransmissions;
+  uint16_t drops;
+  clock_time_t start;  // first packet of the reporting interval
+  clock_time_t end;    // last packet
+  // Same instants in seconds, clock_time() may wrap on long-lived flows
+  unsigned long start_seconds;
+  unsigned long end_seconds;
+  uint8_t active;
 } flow_t;
+
+typedef struct ipflow_stats{
+  uint16_t max_flows;           // flow table occupancy high-water mark
+  uint16_t evictions;           // idle flows removed in delta reporting
+  uint16_t overflows;           // new flows refused, table was full
+  uint32_t packets_seen;
+  uint32_t packets_accounted;
+  uint32_t messages;            // messages sent, exported or relayed
+  uint32_t octets;
+  rtimer_clock_t encode_ticks;  // longest message encoding
+  uint16_t dropped_sends;       // messages too large for the uIP buffer
+  // Local only, not in the options template
+  uint32_t lookups;             // flow table searches
+  uint32_t lookup_steps;        // entries compared by those searches
+  uint16_t max_message;         // largest message exported
+  uint16_t aggregate_overflows; // packets missing from a full aggregation level
+} ipflow_stats_t;
 /*---------------------------------------------------------------------------*/
 
 /** Method definition **/
 void launch_ipflow(int compression_mode, int role);
 void set_collector_addr(uip_ipaddr_t *addr);
+int add_collector_addr(uip_ipaddr_t *addr);
+void set_collectors_mode(int mode);
+uip_ipaddr_t * get_collector_addr(uint32_t domain_id);
+void set_export_transport(int transport);
+int get_upstream_addr(uip_ipaddr_t *addr);
+int get_rpl_depth();
+int get_export_slot();
+int get_export_tier();
+clock_time_t get_export_offset(int tier, int slot);
 int get_process_status();
 int update_flow_table(uip_ipaddr_t *destination, uint16_t size, uint16_t packets);
 int get_number_flows();
+int get_number_exported_flows();
+void set_delta_reporting(int enable);
 void flush_flow_table();
+flow_t * get_flow_table_head();
+void set_sampling_rate(int rate);
+int get_sampling_rate();
+int set_export_interval(int minutes);
+int get_export_interval();
+void export_now();
+const ipflow_stats_t * get_ipflow_stats();
 
 uint8_t * get_octet_delta_count();
 uint8_t * get_packet_delta_count();
 uint8_t * get_destination_node_id();
 uint8_t * get_source_node_id();
+uint8_t * get_onair_octet_count();
+uint8_t * get_fragment_count();
+uint8_t * get_retransmission_count();
+uint8_t * get_drop_count();
+uint8_t * get_flow_start_delta();
+uint8_t * get_flow_end_delta();
+
+uint8_t * get_observation_domain_id();
+uint8_t * get_max_flows_count();
+uint8_t * get_eviction_count();
+uint8_t * get_overflow_count();
+uint8_t * get_packets_seen_count();
+uint8_t * get_packets_accounted_count();
+uint8_t * get_exported_message_count();
+uint8_t * get_exported_octet_count();
+uint8_t * get_encode_ticks();
+uint8_t * get_dropped_send_count();
 
 /*---------------------------------------------------------------------------*/
 
@@ -54,5 +283,23 @@ uint8_t * get_source_node_id();
 #define PACKET_DELTA_COUNT create_ipfix_information_element(2, 2, 0, &get_packet_delta_count)
 #define SOURCE_NODE_ID create_ipfix_information_element(32770, 2, 20763, &get_source_node_id)
 #define DESTINATION_NODE_ID create_ipfix_information_element(32771, 2, 20763, &get_destination_node_id)
+#define ONAIR_OCTET_COUNT create_ipfix_information_element(32772, 2, 20763, &get_onair_octet_count)
+#define FRAGMENT_COUNT create_ipfix_information_element(32773, 2, 20763, &get_fragment_count)
+#define RETRANSMISSION_COUNT create_ipfix_information_element(32774, 2, 20763, &get_retransmission_count)
+#define DROP_COUNT create_ipfix_information_element(32775, 2, 20763, &get_drop_count)
+#define FLOW_START_DELTA_MICROSECONDS create_ipfix_information_element(158, 4, 0, &get_flow_start_delta)
+#define FLOW_END_DELTA_MICROSECONDS create_ipfix_information_element(159, 4, 0, &get_flow_end_delta)
+
+/** Self-telemetry options template fields **/
+#define OBSERVATION_DOMAIN_ID create_ipfix_information_element(149, 4, 0, &get_observation_domain_id)
+#define MAX_FLOWS_COUNT create_ipfix_information_element(32776, 2, 20763, &get_max_flows_count)
+#define EVICTION_COUNT create_ipfix_information_element(32777, 2, 20763, &get_eviction_count)
+#define OVERFLOW_COUNT create_ipfix_information_element(32778, 2, 20763, &get_overflow_count)
+#define PACKETS_SEEN_COUNT create_ipfix_information_element(32779, 4, 20763, &get_packets_seen_count)
+#define PACKETS_ACCOUNTED_COUNT create_ipfix_information_element(32780, 4, 20763, &get_packets_accounted_count)
+#define EXPORTED_MESSAGE_TOTAL_COUNT create_ipfix_information_element(41, 4, 0, &get_exported_message_count)
+#define EXPORTED_OCTET_TOTAL_COUNT create_ipfix_information_element(40, 4, 0, &get_exported_octet_count)
+#define ENCODE_TICKS create_ipfix_information_element(32781, sizeof(rtimer_clock_t), 20763, &get_encode_ticks)
+#define DROPPED_SEND_COUNT create_ipfix_information_element(32782, 2, 20763, &get_dropped_send_count)
 
 #endif /* IPFLOW_H_ */
@@ -67,7 +67,11 @@
 #include "net/ipv6/uip-ds6.h"
 #include "net/rime/rime.h"
 #include "net/ipv6/sicslowpan.h"
+#include "net/ipv6/uip-packet-observer.h"
 #include "net/netstack.h"
+#if SICSLOWPAN_CONF_FRAG_FORWARDING && UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl-private.h"
+#endif
 
 #include <stdio.h>
 
@@ -112,6 +116,43 @@ void uip_log(char *msg);
 #endif /* SICSLOWPAN_CONF_COMPRESSION */
 #endif /* SICSLOWPAN_COMPRESSION */
 
+/* Number of packets whose MAC transmission outcome can be tracked at the
+   same time for the packet observers */
+#ifdef SICSLOWPAN_CONF_TX_CONTEXTS
+#define SICSLOWPAN_TX_CONTEXTS SICSLOWPAN_CONF_TX_CONTEXTS
+#else
+#define SICSLOWPAN_TX_CONTEXTS 4
+#endif
+
+/* Number of packets that can be reassembled at the same time, each from
+   its own sender. When all are in use, the least recently used one is
+   given up for a new packet. */
+#ifdef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_REASS_CONTEXTS SICSLOWPAN_CONF_REASS_CONTEXTS
+#else
+#define SICSLOWPAN_REASS_CONTEXTS 1
+#endif
+
+/* Forward the fragments of packets for other nodes as they arrive instead
+   of reassembling the packets first: the first fragment decides the next
+   hop, the following ones are relabeled with the tag it was sent with. */
+#ifdef SICSLOWPAN_CONF_FRAG_FORWARDING
+#define SICSLOWPAN_FRAG_FORWARDING SICSLOWPAN_CONF_FRAG_FORWARDING
+#else
+#define SICSLOWPAN_FRAG_FORWARDING 0
+#endif
+
+#if SICSLOWPAN_FRAG_FORWARDING && !UIP_CONF_ROUTER
+#error SICSLOWPAN_CONF_FRAG_FORWARDING needs UIP_CONF_ROUTER
+#endif
+
+/* Number of packets whose fragments can be forwarded at the same time */
+#ifdef SICSLOWPAN_CONF_FRAG_FORWARD_ENTRIES
+#define SICSLOWPAN_FRAG_FORWARD_ENTRIES SICSLOWPAN_CONF_FRAG_FORWARD_ENTRIES
+#else
+#define SICSLOWPAN_FRAG_FORWARD_ENTRIES 4
+#endif
+
 #define GET16(ptr,index) (((uint16_t)((ptr)[index] << 8)) | ((ptr)[(index) + 1]))
 #define SET16(ptr,index,value) do {     \
   (ptr)[index] = ((value) >> 8) & 0xff; \
@@ -221,35 +262,66 @@ static int last_tx_status;
  *  @{
  */
 
-static uint16_t sicslowpan_len;
-
-/**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
- */
-static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
-
 /** The total length of the IPv6 packet in the sicslowpan_buf. */
+static uint16_t sicslowpan_len;
 
 /**
- * length of the ip packet already sent / received.
- * It includes IP and transport headers.
+ * The buffer the incoming packet is uncompressed to: the buffer of its
+ * reassembly context if it is fragmented, uip_buf otherwise.
  */
-static uint16_t processed_ip_in_len;
+static uint8_t *sicslowpan_buf;
 
 /** Datagram tag to be put in the fragments I send. */
 static uint16_t my_tag;
 
-/** When reassembling, the tag in the fragments being merged. */
-static uint16_t reass_tag;
+/** A packet being reassembled */
+struct reass_context {
+  /**
+   * The buffer used for the 6lowpan reassembly.
+   * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
+   * It has a fix size as we do not use dynamic memory allocation.
+   */
+  uip_buf_t buf;
+  /** The total length of the IPv6 packet, 0 when the context is free. */
+  uint16_t len;
+  /**
+   * length of the ip packet already received.
+   * It includes IP and transport headers.
+   */
+  uint16_t processed_ip_in_len;
+  /** The tag in the fragments being merged. */
+  uint16_t tag;
+  /** The source address of the fragments being merged */
+  linkaddr_t sender;
+  /** Reassembly %process %timer. */
+  struct timer timer;
+  /** Value of reass_clock when a fragment was last merged */
+  uint16_t last_used;
+};
 
-/** When reassembling, the source address of the fragments being merged */
-linkaddr_t frag_sender;
+static struct reass_context reass_contexts[SICSLOWPAN_REASS_CONTEXTS];
+
+/** Counts merged fragments, to find the least recently used context */
+static uint16_t reass_clock;
+
+#if SICSLOWPAN_FRAG_FORWARDING
+/** A packet whose fragments are forwarded as they arrive */
+struct frag_forward {
+  /** The source address and tag of the incoming fragments */
+  linkaddr_t sender;
+  uint16_t tag;
+  /** The size of the packet, 0 when the entry is free */
+  uint16_t size;
+  /** The next hop of the fragments, and the tag they are sent with.
+      The fragments are dropped when the next hop is linkaddr_null. */
+  linkaddr_t nexthop;
+  uint16_t out_tag;
+  /** Forwarding %timer, the entry is dropped when it expires */
+  struct timer timer;
+};
 
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+static struct frag_forward frag_forwards[SICSLOWPAN_FRAG_FORWARD_ENTRIES];
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
 
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
@@ -266,6 +338,26 @@ static int last_rssi;
 /*-------------------------------------------------------------------------*/
 static struct rime_sniffer *callback = NULL;
 
+#if UIP_PACKET_OBSERVERS
+/* On-air accounting of the packet being sent, reported to the packet
+   observers at the end of output() */
+static uint16_t out_link_len;
+static uint8_t out_link_overhead;
+static uint8_t out_hdr_len;
+static uint8_t out_fragments;
+
+/* Addresses of a packet whose frames are still in the MAC, so that their
+   transmission outcome can be reported once the packet is gone from
+   uip_buf. A context is in use while it has frames pending. */
+struct tx_context {
+  uip_ipaddr_t srcipaddr;
+  uip_ipaddr_t destipaddr;
+  uint8_t pending;
+};
+static struct tx_context tx_contexts[SICSLOWPAN_TX_CONTEXTS];
+static struct tx_context *out_context;
+#endif /* UIP_PACKET_OBSERVERS */
+
 void
 rime_sniffer_add(struct rime_sniffer *s)
 {
@@ -327,6 +419,36 @@ static struct sicslowpan_addr_context *context;
 /** pointer to the byte where to write next inline field. */
 static uint8_t *hc06_ptr;
 
+/**
+ * Number of (source, destination, link destination) triples whose
+ * address encoding is remembered, so that a flow does not look up the
+ * contexts and compare IIDs with link addresses for every packet.
+ */
+#ifdef SICSLOWPAN_CONF_IPHC_CACHE
+#define SICSLOWPAN_IPHC_CACHE SICSLOWPAN_CONF_IPHC_CACHE
+#else
+#define SICSLOWPAN_IPHC_CACHE 1
+#endif
+
+/** The encoding of a pair of addresses, as compress_hdr_hc06 emits it */
+struct iphc_addr_cache {
+  uip_ipaddr_t srcipaddr;
+  uip_ipaddr_t destipaddr;
+  linkaddr_t link_destaddr;
+  /** The CID, SAC, SAM, M, DAC and DAM bits of the second IPHC byte */
+  uint8_t iphc1;
+  /** The SCI | DCI byte, used if iphc1 has CID */
+  uint8_t cid;
+  /** The inline address fields */
+  uint8_t len;
+  uint8_t addr[32];
+};
+
+static struct iphc_addr_cache iphc_addr_cache[SICSLOWPAN_IPHC_CACHE > 0 ? SICSLOWPAN_IPHC_CACHE : 1];
+/** Number of valid entries, and the entry to replace next */
+static uint8_t iphc_addr_cache_len;
+static uint8_t iphc_addr_cache_next;
+
 /* Uncompression of linklocal */
 /*   0 -> 16 bytes from packet  */
 /*   1 -> 2 bytes from prefix - bunch of zeroes and 8 from packet */
@@ -454,6 +576,142 @@ uncompress_addr(uip_ipaddr_t *ipaddr, uint8_t const prefix[],
   PRINTF("\n");
 }
 
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Get the IPHC encoding of the addresses of the packet in uip_buf
+ * \param link_destaddr L2 destination address, needed to compress IP
+ * dest
+ *
+ * The encoding only depends on the addresses, the link destination and
+ * the contexts, so the last ones computed are kept in iphc_addr_cache.
+ */
+static const struct iphc_addr_cache *
+compress_addrs_hc06(linkaddr_t *link_destaddr)
+{
+  struct iphc_addr_cache *e;
+  uint8_t *ptr;
+  uint8_t i;
+
+  for(i = 0; i < iphc_addr_cache_len; i++) {
+    e = &iphc_addr_cache[i];
+    if(uip_ipaddr_cmp(&e->destipaddr, &UIP_IP_BUF->destipaddr) &&
+       uip_ipaddr_cmp(&e->srcipaddr, &UIP_IP_BUF->srcipaddr) &&
+       linkaddr_cmp(&e->link_destaddr, link_destaddr)) {
+      return e;
+    }
+  }
+
+  e = &iphc_addr_cache[iphc_addr_cache_next];
+#if SICSLOWPAN_IPHC_CACHE > 0
+  if(iphc_addr_cache_len < SICSLOWPAN_IPHC_CACHE) {
+    iphc_addr_cache_len++;
+  }
+  iphc_addr_cache_next = (iphc_addr_cache_next + 1) % SICSLOWPAN_IPHC_CACHE;
+#endif /* SICSLOWPAN_IPHC_CACHE > 0 */
+  uip_ipaddr_copy(&e->srcipaddr, &UIP_IP_BUF->srcipaddr);
+  uip_ipaddr_copy(&e->destipaddr, &UIP_IP_BUF->destipaddr);
+  linkaddr_copy(&e->link_destaddr, link_destaddr);
+  e->iphc1 = 0;
+  e->cid = 0;
+
+  /* The inline fields are written to the entry */
+  ptr = hc06_ptr;
+  hc06_ptr = e->addr;
+
+  /* check if dest context exists (for allocating third byte) */
+  if(addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr) != NULL ||
+     addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr) != NULL) {
+    /* set context flag */
+    PRINTF("IPHC: compressing dest or src ipaddr - setting CID\n");
+    e->iphc1 |= SICSLOWPAN_IPHC_CID;
+  }
+
+  /* source address - cannot be multicast */
+  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+    PRINTF("IPHC: compressing unspecified - setting SAC\n");
+    e->iphc1 |= SICSLOWPAN_IPHC_SAC;
+    e->iphc1 |= SICSLOWPAN_IPHC_SAM_00;
+  } else if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr))
+     != NULL) {
+    /* elide the prefix - indicate by CID and set context + SAC */
+    PRINTF("IPHC: compressing src with context - setting CID & SAC ctx: %d\n",
+	   context->number);
+    e->iphc1 |= SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_SAC;
+    e->cid |= context->number << 4;
+    /* compession compare with this nodes address (source) */
+
+    e->iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
+                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+    /* No context found for this address */
+  } else if(uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) &&
+	    UIP_IP_BUF->destipaddr.u16[1] == 0 &&
+	    UIP_IP_BUF->destipaddr.u16[2] == 0 &&
+	    UIP_IP_BUF->destipaddr.u16[3] == 0) {
+    e->iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
+                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+  } else {
+    /* send the full address => SAC = 0, SAM = 00 */
+    e->iphc1 |= SICSLOWPAN_IPHC_SAM_00; /* 128-bits */
+    memcpy(hc06_ptr, &UIP_IP_BUF->srcipaddr.u16[0], 16);
+    hc06_ptr += 16;
+  }
+
+  /* dest address*/
+  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+    /* Address is multicast, try to compress */
+    e->iphc1 |= SICSLOWPAN_IPHC_M;
+    if(sicslowpan_is_mcast_addr_compressable8(&UIP_IP_BUF->destipaddr)) {
+      e->iphc1 |= SICSLOWPAN_IPHC_DAM_11;
+      /* use last byte */
+      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[15];
+      hc06_ptr += 1;
+    } else if(sicslowpan_is_mcast_addr_compressable32(&UIP_IP_BUF->destipaddr)) {
+      e->iphc1 |= SICSLOWPAN_IPHC_DAM_10;
+      /* second byte + the last three */
+      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
+      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[13], 3);
+      hc06_ptr += 4;
+    } else if(sicslowpan_is_mcast_addr_compressable48(&UIP_IP_BUF->destipaddr)) {
+      e->iphc1 |= SICSLOWPAN_IPHC_DAM_01;
+      /* second byte + the last five */
+      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
+      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[11], 5);
+      hc06_ptr += 6;
+    } else {
+      e->iphc1 |= SICSLOWPAN_IPHC_DAM_00;
+      /* full address */
+      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u8[0], 16);
+      hc06_ptr += 16;
+    }
+  } else {
+    /* Address is unicast, try to compress */
+    if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr)) != NULL) {
+      /* elide the prefix */
+      e->iphc1 |= SICSLOWPAN_IPHC_DAC;
+      e->cid |= context->number;
+      /* compession compare with link adress (destination) */
+
+      e->iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
+	       &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
+      /* No context found for this address */
+    } else if(uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) &&
+	      UIP_IP_BUF->destipaddr.u16[1] == 0 &&
+	      UIP_IP_BUF->destipaddr.u16[2] == 0 &&
+	      UIP_IP_BUF->destipaddr.u16[3] == 0) {
+      e->iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
+               &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
+    } else {
+      /* send the full address */
+      e->iphc1 |= SICSLOWPAN_IPHC_DAM_00; /* 128-bits */
+      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u16[0], 16);
+      hc06_ptr += 16;
+    }
+  }
+
+  e->len = hc06_ptr - e->addr;
+  hc06_ptr = ptr;
+  return e;
+}
 /*--------------------------------------------------------------------*/
 /**
  * \brief Compress IP/UDP header
@@ -493,6 +751,7 @@ static void
 compress_hdr_hc06(linkaddr_t *link_destaddr)
 {
   uint8_t tmp, iphc0, iphc1;
+  const struct iphc_addr_cache *addrs;
 #if DEBUG
   { uint16_t ndx;
     PRINTF("before compression (%d): ", UIP_IP_BUF->len[1]);
@@ -514,23 +773,15 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
 
   iphc0 = SICSLOWPAN_DISPATCH_IPHC;
   iphc1 = 0;
-  PACKETBUF_IPHC_BUF[2] = 0; /* might not be used - but needs to be cleared */
 
   /*
    * Address handling needs to be made first since it might
    * cause an extra byte with [ SCI | DCI ]
    *
    */
-
-
-  /* check if dest context exists (for allocating third byte) */
-  /* TODO: fix this so that it remembers the looked up values for
-     avoiding two lookups - or set the lookup values immediately */
-  if(addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr) != NULL ||
-     addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr) != NULL) {
-    /* set context flag and increase hc06_ptr */
-    PRINTF("IPHC: compressing dest or src ipaddr - setting CID\n");
-    iphc1 |= SICSLOWPAN_IPHC_CID;
+  addrs = compress_addrs_hc06(link_destaddr);
+  if(addrs->iphc1 & SICSLOWPAN_IPHC_CID) {
+    PACKETBUF_IPHC_BUF[2] = addrs->cid;
     hc06_ptr++;
   }
 
@@ -618,87 +869,10 @@ compress_hdr_hc06(linkaddr_t *link_destaddr)
       break;
   }
 
-  /* source address - cannot be multicast */
-  if(uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
-    PRINTF("IPHC: compressing unspecified - setting SAC\n");
-    iphc1 |= SICSLOWPAN_IPHC_SAC;
-    iphc1 |= SICSLOWPAN_IPHC_SAM_00;
-  } else if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr))
-     != NULL) {
-    /* elide the prefix - indicate by CID and set context + SAC */
-    PRINTF("IPHC: compressing src with context - setting CID & SAC ctx: %d\n",
-	   context->number);
-    iphc1 |= SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_SAC;
-    PACKETBUF_IPHC_BUF[2] |= context->number << 4;
-    /* compession compare with this nodes address (source) */
-
-    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
-                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
-    /* No context found for this address */
-  } else if(uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr) &&
-	    UIP_IP_BUF->destipaddr.u16[1] == 0 &&
-	    UIP_IP_BUF->destipaddr.u16[2] == 0 &&
-	    UIP_IP_BUF->destipaddr.u16[3] == 0) {
-    iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
-                              &UIP_IP_BUF->srcipaddr, &uip_lladdr);
-  } else {
-    /* send the full address => SAC = 0, SAM = 00 */
-    iphc1 |= SICSLOWPAN_IPHC_SAM_00; /* 128-bits */
-    memcpy(hc06_ptr, &UIP_IP_BUF->srcipaddr.u16[0], 16);
-    hc06_ptr += 16;
-  }
-
-  /* dest address*/
-  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
-    /* Address is multicast, try to compress */
-    iphc1 |= SICSLOWPAN_IPHC_M;
-    if(sicslowpan_is_mcast_addr_compressable8(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_11;
-      /* use last byte */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[15];
-      hc06_ptr += 1;
-    } else if(sicslowpan_is_mcast_addr_compressable32(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_10;
-      /* second byte + the last three */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
-      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[13], 3);
-      hc06_ptr += 4;
-    } else if(sicslowpan_is_mcast_addr_compressable48(&UIP_IP_BUF->destipaddr)) {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_01;
-      /* second byte + the last five */
-      *hc06_ptr = UIP_IP_BUF->destipaddr.u8[1];
-      memcpy(hc06_ptr + 1, &UIP_IP_BUF->destipaddr.u8[11], 5);
-      hc06_ptr += 6;
-    } else {
-      iphc1 |= SICSLOWPAN_IPHC_DAM_00;
-      /* full address */
-      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u8[0], 16);
-      hc06_ptr += 16;
-    }
-  } else {
-    /* Address is unicast, try to compress */
-    if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr)) != NULL) {
-      /* elide the prefix */
-      iphc1 |= SICSLOWPAN_IPHC_DAC;
-      PACKETBUF_IPHC_BUF[2] |= context->number;
-      /* compession compare with link adress (destination) */
-
-      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
-	       &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
-      /* No context found for this address */
-    } else if(uip_is_addr_link_local(&UIP_IP_BUF->destipaddr) &&
-	      UIP_IP_BUF->destipaddr.u16[1] == 0 &&
-	      UIP_IP_BUF->destipaddr.u16[2] == 0 &&
-	      UIP_IP_BUF->destipaddr.u16[3] == 0) {
-      iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
-               &UIP_IP_BUF->destipaddr, (uip_lladdr_t *)link_destaddr);
-    } else {
-      /* send the full address */
-      iphc1 |= SICSLOWPAN_IPHC_DAM_00; /* 128-bits */
-      memcpy(hc06_ptr, &UIP_IP_BUF->destipaddr.u16[0], 16);
-      hc06_ptr += 16;
-    }
-  }
+  /* source and dest addresses */
+  iphc1 |= addrs->iphc1;
+  memcpy(hc06_ptr, addrs->addr, addrs->len);
+  hc06_ptr += addrs->len;
 
   uncomp_hdr_len = UIP_IPH_LEN;
 
@@ -1303,12 +1477,38 @@ compress_hdr_ipv6(linkaddr_t *link_destaddr)
 /** \name Input/output functions common to all compression schemes
  * @{                                                                 */
 /*--------------------------------------------------------------------*/
+#if UIP_PACKET_OBSERVERS
+static struct tx_context *
+new_tx_context(void)
+{
+  int i;
+  for(i = 0; i < SICSLOWPAN_TX_CONTEXTS; i++) {
+    if(tx_contexts[i].pending == 0) {
+      uip_ipaddr_copy(&tx_contexts[i].srcipaddr, &UIP_IP_BUF->srcipaddr);
+      uip_ipaddr_copy(&tx_contexts[i].destipaddr, &UIP_IP_BUF->destipaddr);
+      return &tx_contexts[i];
+    }
+  }
+  /* All busy, the outcome of this packet will not be reported */
+  return NULL;
+}
+#endif /* UIP_PACKET_OBSERVERS */
+/*--------------------------------------------------------------------*/
 /**
  * Callback function for the MAC packet sent callback
  */
 static void
 packet_sent(void *ptr, int status, int transmissions)
 {
+#if UIP_PACKET_OBSERVERS
+  struct tx_context *context = ptr;
+  if(context != NULL && context->pending > 0) {
+    context->pending--;
+    uip_packet_observer_mac_call(&context->srcipaddr, &context->destipaddr,
+                                 status, transmissions);
+  }
+#endif /* UIP_PACKET_OBSERVERS */
+
   uip_ds6_link_neighbor_callback(status, transmissions);
 
   if(callback != NULL) {
@@ -1336,9 +1536,20 @@ send_packet(linkaddr_t *dest)
   packetbuf_set_addr(PACKETBUF_ADDR_SENDER,(void*)&uip_lladdr);
 #endif
 
+#if UIP_PACKET_OBSERVERS
+  out_link_len += packetbuf_datalen() + out_link_overhead;
+  if(out_context != NULL) {
+    out_context->pending++;
+  }
+
+  /* Provide a callback function to receive the result of
+     a packet transmission. */
+  NETSTACK_LLSEC.send(&packet_sent, out_context);
+#else /* UIP_PACKET_OBSERVERS */
   /* Provide a callback function to receive the result of
      a packet transmission. */
   NETSTACK_LLSEC.send(&packet_sent, NULL);
+#endif /* UIP_PACKET_OBSERVERS */
 
   /* If we are sending multiple packets in a row, we need to let the
      watchdog know that we are still alive. */
@@ -1428,6 +1639,12 @@ output(const uip_lladdr_t *localdest)
     compress_hdr_ipv6(&dest);
   }
   PRINTFO("sicslowpan output: header of len %d\n", packetbuf_hdr_len);
+#if UIP_PACKET_OBSERVERS
+  out_hdr_len = packetbuf_hdr_len;
+  out_link_len = 0;
+  out_fragments = 0;
+  out_context = new_tx_context();
+#endif /* UIP_PACKET_OBSERVERS */
 
   /* Calculate NETSTACK_FRAMER's header length, that will be added in the NETSTACK_RDC.
    * We calculate it here only to make a better decision of whether the outgoing packet
@@ -1444,6 +1661,9 @@ output(const uip_lladdr_t *localdest)
   framer_hdrlen = 21;
 #endif /* USE_FRAMER_HDRLEN */
   max_payload = MAC_MAX_PAYLOAD - framer_hdrlen - NETSTACK_LLSEC.get_overhead();
+#if UIP_PACKET_OBSERVERS
+  out_link_overhead = framer_hdrlen + NETSTACK_LLSEC.get_overhead();
+#endif /* UIP_PACKET_OBSERVERS */
 
   if((int)uip_len - (int)uncomp_hdr_len > max_payload - (int)packetbuf_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
@@ -1495,6 +1715,9 @@ output(const uip_lladdr_t *localdest)
       PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
       return 0;
     }
+#if UIP_PACKET_OBSERVERS
+    out_fragments++;
+#endif /* UIP_PACKET_OBSERVERS */
     send_packet(&dest);
     queuebuf_to_packetbuf(q);
     queuebuf_free(q);
@@ -1505,6 +1728,8 @@ output(const uip_lladdr_t *localdest)
        (last_tx_status == MAC_TX_ERR) ||
        (last_tx_status == MAC_TX_ERR_FATAL)) {
       PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
+      UIP_PACKET_OBSERVE_LINK(out_link_len, out_hdr_len, out_fragments,
+                              (const uip_lladdr_t *)&dest);
       return 0;
     }
 
@@ -1539,8 +1764,13 @@ output(const uip_lladdr_t *localdest)
       q = queuebuf_new_from_packetbuf();
       if(q == NULL) {
         PRINTFO("could not allocate queuebuf, dropping fragment\n");
+        UIP_PACKET_OBSERVE_LINK(out_link_len, out_hdr_len, out_fragments,
+                              (const uip_lladdr_t *)&dest);
         return 0;
       }
+#if UIP_PACKET_OBSERVERS
+      out_fragments++;
+#endif /* UIP_PACKET_OBSERVERS */
       send_packet(&dest);
       queuebuf_to_packetbuf(q);
       queuebuf_free(q);
@@ -1552,6 +1782,8 @@ output(const uip_lladdr_t *localdest)
          (last_tx_status == MAC_TX_ERR) ||
          (last_tx_status == MAC_TX_ERR_FATAL)) {
         PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
+        UIP_PACKET_OBSERVE_LINK(out_link_len, out_hdr_len, out_fragments,
+                              (const uip_lladdr_t *)&dest);
         return 0;
       }
     }
@@ -1570,9 +1802,312 @@ output(const uip_lladdr_t *localdest)
     packetbuf_set_datalen(uip_len - uncomp_hdr_len + packetbuf_hdr_len);
     send_packet(&dest);
   }
+  UIP_PACKET_OBSERVE_LINK(out_link_len, out_hdr_len, out_fragments,
+                          (const uip_lladdr_t *)&dest);
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/** \brief Find the context reassembling a fragment's packet, if any */
+static struct reass_context *
+reass_lookup(uint16_t tag, uint16_t size, const linkaddr_t *sender)
+{
+  struct reass_context *c;
+
+  for(c = reass_contexts; c < reass_contexts + SICSLOWPAN_REASS_CONTEXTS; c++) {
+    if(c->len != 0 && timer_expired(&c->timer)) {
+      /* Reassembly timed out, cancel it */
+      c->len = 0;
+    }
+    if(c->len == size && c->tag == tag && linkaddr_cmp(&c->sender, sender)) {
+      return c;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Get a context to reassemble a new packet in: a free one, or the
+ * least recently used one whose packet is given up.
+ */
+static struct reass_context *
+reass_alloc(void)
+{
+  struct reass_context *c;
+  struct reass_context *lru;
+
+  lru = reass_contexts;
+  for(c = reass_contexts; c < reass_contexts + SICSLOWPAN_REASS_CONTEXTS; c++) {
+    if(c->len == 0 || timer_expired(&c->timer)) {
+      return c;
+    }
+    if((uint16_t)(reass_clock - c->last_used) >
+       (uint16_t)(reass_clock - lru->last_used)) {
+      lru = c;
+    }
+  }
+  PRINTFI("sicslowpan input: Dropping the packet of the least recently used reassembly context\n");
+  return lru;
+}
+#if SICSLOWPAN_FRAG_FORWARDING
+/*--------------------------------------------------------------------*/
+/** \brief Find the forwarding entry of a fragment's packet, if any */
+static struct frag_forward *
+frag_forward_lookup(uint16_t tag, uint16_t size, const linkaddr_t *sender)
+{
+  struct frag_forward *f;
+
+  for(f = frag_forwards; f < frag_forwards + SICSLOWPAN_FRAG_FORWARD_ENTRIES; f++) {
+    if(f->size != 0 && timer_expired(&f->timer)) {
+      f->size = 0;
+    }
+    if(f->size == size && f->tag == tag && linkaddr_cmp(&f->sender, sender)) {
+      return f;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Get the link-layer address of the next hop towards a
+ * destination, if it is known without address resolution
+ */
+static const uip_lladdr_t *
+frag_forward_nexthop(uip_ipaddr_t *destipaddr)
+{
+  uip_ds6_route_t *route;
+  uip_ipaddr_t *nexthop;
+  uip_ds6_nbr_t *nbr;
+
+  if(uip_ds6_is_addr_onlink(destipaddr)) {
+    nexthop = destipaddr;
+  } else {
+    route = uip_ds6_route_lookup(destipaddr);
+    if(route != NULL) {
+      nexthop = uip_ds6_route_nexthop(route);
+    } else {
+      nexthop = uip_ds6_defrt_choose();
+    }
+  }
+  if(nexthop == NULL) {
+    return NULL;
+  }
+  nbr = uip_ds6_nbr_lookup(nexthop);
+  if(nbr == NULL || nbr->state == NBR_INCOMPLETE) {
+    return NULL;
+  }
+  return uip_ds6_nbr_get_ll(nbr);
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Forward the first fragment of a packet for another node.
+ * \param frag_tag The tag of the fragment
+ * \param frag_size The size of the packet
+ * \param len The number of bytes of the packet in sicslowpan_buf
+ * \return 1 if the fragment was forwarded, 0 if the packet must be
+ * reassembled instead
+ *
+ * The packet's headers are compressed again for the next hop, and the
+ * fragment is sent with a tag of ours. Only packets without extension
+ * headers are forwarded this way, except for the RPL hop-by-hop option
+ * which is checked and updated as uip_process() would. RPL packets
+ * without the option are left to the IP layer, which inserts it.
+ */
+static int
+frag_forward_first(uint16_t frag_tag, uint16_t frag_size, uint16_t len)
+{
+  struct frag_forward *f;
+  const uip_lladdr_t *lladdr;
+  linkaddr_t sender;
+  linkaddr_t dest;
+  int framer_hdrlen;
+  uint8_t rx_uncomp_hdr_len;
+  uint8_t rx_packetbuf_hdr_len;
+  uint8_t proto;
+  int new_entry;
+
+  proto = SICSLOWPAN_IP_BUF->proto;
+#if UIP_CONF_IPV6_RPL
+  if(proto == UIP_PROTO_HBHO && len >= UIP_IPH_LEN + RPL_HOP_BY_HOP_LEN) {
+    proto = sicslowpan_buf[UIP_LLIPH_LEN];
+  } else if(RPL_INSERT_HBH_OPTION) {
+    /* The option must be inserted, the packet grows */
+    return 0;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+  if((proto != UIP_PROTO_UDP && proto != UIP_PROTO_TCP &&
+      proto != UIP_PROTO_ICMP6) ||
+     SICSLOWPAN_IP_BUF->ttl <= 1 ||
+     uip_is_addr_mcast(&SICSLOWPAN_IP_BUF->destipaddr) ||
+     uip_is_addr_link_local(&SICSLOWPAN_IP_BUF->destipaddr) ||
+     uip_is_addr_link_local(&SICSLOWPAN_IP_BUF->srcipaddr) ||
+     uip_is_addr_unspecified(&SICSLOWPAN_IP_BUF->srcipaddr) ||
+     uip_ds6_is_my_addr(&SICSLOWPAN_IP_BUF->destipaddr) ||
+     uip_ds6_is_my_aaddr(&SICSLOWPAN_IP_BUF->destipaddr)) {
+    return 0;
+  }
+
+  lladdr = frag_forward_nexthop(&SICSLOWPAN_IP_BUF->destipaddr);
+  if(lladdr == NULL) {
+    return 0;
+  }
+  linkaddr_copy(&dest, (const linkaddr_t *)lladdr);
+
+  /* Reuse the entry of an earlier copy of this fragment, or a free one */
+  linkaddr_copy(&sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  f = frag_forward_lookup(frag_tag, frag_size, &sender);
+  new_entry = f == NULL || linkaddr_cmp(&f->nexthop, &linkaddr_null);
+  if(f == NULL) {
+    for(f = frag_forwards; f < frag_forwards + SICSLOWPAN_FRAG_FORWARD_ENTRIES; f++) {
+      if(f->size == 0 || timer_expired(&f->timer)) {
+        break;
+      }
+    }
+    if(f == frag_forwards + SICSLOWPAN_FRAG_FORWARD_ENTRIES) {
+      PRINTFI("sicslowpan input: no fragment forwarding entry left\n");
+      return 0;
+    }
+  }
+
+  /* Build the packet's first bytes in uip_buf, as if the IP layer had
+     forwarded it */
+  memcpy(UIP_IP_BUF, SICSLOWPAN_IP_BUF, len);
+#if UIP_CONF_IPV6_RPL
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO) {
+    /* Rank and loop checks, then our rank in the option. The option
+       keeps its size, the following fragments are left unchanged. */
+    uip_ext_len = 0;
+    if(rpl_verify_header(2) || rpl_update_header_empty()) {
+      PRINTFI("sicslowpan input: RPL option error, dropping fragments\n");
+      linkaddr_copy(&f->sender, &sender);
+      f->tag = frag_tag;
+      f->size = frag_size;
+      linkaddr_copy(&f->nexthop, &linkaddr_null);
+      timer_set(&f->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+      return 1;
+    }
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+  UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+
+  rx_uncomp_hdr_len = uncomp_hdr_len;
+  rx_packetbuf_hdr_len = packetbuf_hdr_len;
+  uncomp_hdr_len = 0;
+  packetbuf_hdr_len = 0;
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1
+  compress_hdr_hc1(&dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC1 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6
+  compress_hdr_ipv6(&dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_IPV6 */
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+  compress_hdr_hc06(&dest);
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &dest);
+  framer_hdrlen = NETSTACK_FRAMER.length();
+  if(framer_hdrlen < 0) {
+    /* Framing failed, we assume the maximum header length */
+    framer_hdrlen = 21;
+  }
+  if(SICSLOWPAN_FRAG1_HDR_LEN + packetbuf_hdr_len + len - uncomp_hdr_len >
+     MAC_MAX_PAYLOAD - framer_hdrlen - NETSTACK_LLSEC.get_overhead()) {
+    /* The headers compress worse for the next hop and the fragment no
+       longer fits in a frame. */
+    uncomp_hdr_len = rx_uncomp_hdr_len;
+    packetbuf_hdr_len = rx_packetbuf_hdr_len;
+    return 0;
+  }
+
+  /* FRAG1 dispatch + header, then the rest of the fragment */
+  memmove(packetbuf_ptr + SICSLOWPAN_FRAG1_HDR_LEN, packetbuf_ptr, packetbuf_hdr_len);
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | frag_size));
+  if(new_entry) {
+    f->out_tag = my_tag++;
+  }
+  /* A retransmitted first fragment keeps the tag the others are sent with */
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, f->out_tag);
+  packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
+  memcpy(packetbuf_ptr + packetbuf_hdr_len,
+         (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, len - uncomp_hdr_len);
+  packetbuf_set_datalen(packetbuf_hdr_len + len - uncomp_hdr_len);
+
+  linkaddr_copy(&f->sender, &sender);
+  f->tag = frag_tag;
+  f->size = frag_size;
+  linkaddr_copy(&f->nexthop, &dest);
+  timer_set(&f->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+  PRINTFI("sicslowpan input: forwarding fragments (len %d, tag %d as %d)\n",
+          frag_size, frag_tag, f->out_tag);
+
+#if UIP_PACKET_OBSERVERS
+  out_context = NULL;
+#endif /* UIP_PACKET_OBSERVERS */
+  send_packet(&dest);
+
+  /* Let the packet observers account the whole packet as forwarded */
+  uip_len = frag_size;
+  UIP_PACKET_OBSERVE(UIP_PACKET_OBSERVER_FORWARD);
+  uip_len = 0;
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Forward a subsequent fragment of a packet whose first fragment
+ * was forwarded.
+ * \return 1 if the fragment was forwarded, 0 if it is not from such
+ * a packet
+ */
+static int
+frag_forward_next(uint16_t frag_tag, uint16_t frag_size, uint8_t frag_offset)
+{
+  struct frag_forward *f;
+  uint8_t *data;
+  uint16_t len;
+
+  f = frag_forward_lookup(frag_tag, frag_size,
+                          packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  if(f == NULL) {
+    return 0;
+  }
+
+  /* Relabel the fragment with our tag, and send it on as it is */
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, f->out_tag);
+  len = packetbuf_datalen();
+  if((uint16_t)(frag_offset << 3) + len - SICSLOWPAN_FRAGN_HDR_LEN >= frag_size) {
+    /* This is the last fragment */
+    f->size = 0;
+  }
+  if(linkaddr_cmp(&f->nexthop, &linkaddr_null)) {
+    /* The first fragment was dropped */
+    return 1;
+  }
+
+  data = packetbuf_dataptr();
+  packetbuf_clear();
+  memmove(packetbuf_dataptr(), data, len);
+  packetbuf_set_datalen(len);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  PRINTFI("sicslowpan input: forwarding fragment (offset %d, tag %d as %d)\n",
+          frag_offset, frag_tag, f->out_tag);
+
+#if UIP_PACKET_OBSERVERS
+  out_context = NULL;
+#endif /* UIP_PACKET_OBSERVERS */
+  send_packet(&f->nexthop);
+  return 1;
+}
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+#endif /* SICSLOWPAN_CONF_FRAG */
+
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
@@ -1583,6 +2118,11 @@ output(const uip_lladdr_t *localdest)
  *  copied in siclowpan_buf. If the IP packet is complete it is copied
  *  to uip_buf and the IP layer is called.
  *
+ *  Fragments are merged in the reassembly context of their (sender, tag,
+ *  size), so that packets from several senders can be reassembled at the
+ *  same time. Non-fragmented packets are uncompressed straight to uip_buf
+ *  and leave ongoing reassemblies alone.
+ *
  * \note We do not check for overlapping sicslowpan fragments
  * (it is a SHALL in the RFC 4944 and should never happen)
  */
@@ -1598,6 +2138,8 @@ input(void)
   /* tag of the fragment */
   uint16_t frag_tag = 0;
   uint8_t first_fragment = 0, last_fragment = 0;
+  /* context the fragment is merged in */
+  struct reass_context *reass = NULL;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
   /* init */
@@ -1611,11 +2153,6 @@ input(void)
      want to query us for it later. */
   last_rssi = (signed short)packetbuf_attr(PACKETBUF_ATTR_RSSI);
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1647,77 +2184,55 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       packetbuf_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
-
-      /* If this is the last fragment, we may shave off any extrenous
-         bytes at the end. We must be liberal in what we accept. */
-      PRINTFI("last_fragment?: processed_ip_in_len %d packetbuf_payload_len %d frag_size %d\n",
-              processed_ip_in_len, packetbuf_datalen() - packetbuf_hdr_len, frag_size);
-
-      if(processed_ip_in_len + packetbuf_datalen() - packetbuf_hdr_len >= frag_size) {
-        last_fragment = 1;
-      }
       is_fragment = 1;
       break;
     default:
       break;
   }
 
-  /* We are currently reassembling a packet, but have just received the first
-   * fragment of another packet. We can either ignore it and hope to receive
-   * the rest of the under-reassembly packet fragments, or we can discard the
-   * previous packet altogether, and start reassembling the new packet.
-   *
-   * We discard the previous packet, and start reassembling the new packet.
-   * This lessens the negative impacts of too high SICSLOWPAN_REASS_MAXAGE.
-   */
-#define PRIORITIZE_NEW_PACKETS 1
-#if PRIORITIZE_NEW_PACKETS
-
-  if(!is_fragment) {
-    /* Prioritize non-fragment packets too. */
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  } else if(processed_ip_in_len > 0 && first_fragment
-      && !linkaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
-#endif /* PRIORITIZE_NEW_PACKETS */
-
-  if(processed_ip_in_len > 0) {
-    /* reassembly is ongoing */
-    /*    printf("frag %d %d\n", reass_tag, frag_tag);*/
-    if((frag_size > 0 &&
-        (frag_size != sicslowpan_len ||
-         reass_tag  != frag_tag ||
-         !linkaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       frag_size == 0) {
-      /*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
-       */
-      PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
-      return;
-    }
-  } else {
-    /*
-     * reassembly is off
-     * start it if we received a fragment
-     */
-    if((frag_size > 0) && (frag_size <= UIP_BUFSIZE)) {
-      /* We are currently not reassembling a packet, but have received a packet fragment
-       * that is not the first one. */
-      if(is_fragment && !first_fragment) {
+#if SICSLOWPAN_FRAG_FORWARDING
+  if(is_fragment && !first_fragment &&
+     frag_forward_next(frag_tag, frag_size, frag_offset)) {
+    return;
+  }
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+
+  /* Non-fragmented packets are uncompressed straight to uip_buf */
+  sicslowpan_buf = uip_buf;
+
+  if(is_fragment) {
+    reass = reass_lookup(frag_tag, frag_size,
+                         packetbuf_addr(PACKETBUF_ADDR_SENDER));
+    if(reass == NULL) {
+      /* We are not reassembling this packet, start it if this is its
+       * first fragment. */
+      if(!first_fragment || frag_size == 0 || frag_size > UIP_BUFSIZE) {
+        PRINTFI("sicslowpan input: Dropping 6lowpan fragment of no packet being reassembled\n");
         return;
       }
-
-      sicslowpan_len = frag_size;
-      reass_tag = frag_tag;
-      timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
+      reass = reass_alloc();
+      reass->len = frag_size;
+      reass->tag = frag_tag;
+      linkaddr_copy(&reass->sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+      timer_set(&reass->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND);
       PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-             sicslowpan_len, reass_tag);
-      linkaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+             reass->len, reass->tag);
+    }
+    if(first_fragment) {
+      /* A repeated first fragment starts the packet over */
+      reass->processed_ip_in_len = 0;
+    } else {
+      /* If this is the last fragment, we may shave off any extrenous
+         bytes at the end. We must be liberal in what we accept. */
+      PRINTFI("last_fragment?: processed_ip_in_len %d packetbuf_payload_len %d frag_size %d\n",
+              reass->processed_ip_in_len, packetbuf_datalen() - packetbuf_hdr_len, frag_size);
+
+      if(reass->processed_ip_in_len + packetbuf_datalen() - packetbuf_hdr_len >= frag_size) {
+        last_fragment = 1;
+      }
     }
+    reass->last_used = ++reass_clock;
+    sicslowpan_buf = reass->buf.u8;
   }
 
   if(packetbuf_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
@@ -1779,11 +2294,11 @@ input(void)
   {
     int req_size = UIP_LLH_LEN + uncomp_hdr_len + (uint16_t)(frag_offset << 3)
         + packetbuf_payload_len;
-    if(req_size > sizeof(sicslowpan_buf)) {
+    if(req_size > UIP_BUFSIZE) {
       PRINTF(
           "SICSLOWPAN: packet dropped, minimum required SICSLOWPAN_IP_BUF size: %d+%d+%d+%d=%d (current size: %d)\n",
           UIP_LLH_LEN, uncomp_hdr_len, (uint16_t)(frag_offset << 3),
-          packetbuf_payload_len, req_size, sizeof(sicslowpan_buf));
+          packetbuf_payload_len, req_size, UIP_BUFSIZE);
       return;
     }
   }
@@ -1793,63 +2308,73 @@ input(void)
   /* update processed_ip_in_len if fragment, sicslowpan_len otherwise */
 
 #if SICSLOWPAN_CONF_FRAG
-  if(frag_size > 0) {
+  if(reass != NULL) {
     /* Add the size of the header only for the first fragment. */
     if(first_fragment != 0) {
-      processed_ip_in_len += uncomp_hdr_len;
+      reass->processed_ip_in_len += uncomp_hdr_len;
     }
     /* For the last fragment, we are OK if there is extrenous bytes at
        the end of the packet. */
     if(last_fragment != 0) {
-      processed_ip_in_len = frag_size;
+      reass->processed_ip_in_len = frag_size;
     } else {
-      processed_ip_in_len += packetbuf_payload_len;
+      reass->processed_ip_in_len += packetbuf_payload_len;
+    }
+    PRINTF("processed_ip_in_len %d, packetbuf_payload_len %d\n",
+           reass->processed_ip_in_len, packetbuf_payload_len);
+
+#if SICSLOWPAN_FRAG_FORWARDING
+    if(first_fragment != 0 && last_fragment == 0 &&
+       frag_forward_first(frag_tag, frag_size, reass->processed_ip_in_len)) {
+      /* The following fragments are forwarded too, as they arrive */
+      reass->len = 0;
+      return;
     }
-    PRINTF("processed_ip_in_len %d, packetbuf_payload_len %d\n", processed_ip_in_len, packetbuf_payload_len);
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
 
+    /*
+     * If we have a full IP packet in the context, deliver it to
+     * the IP stack
+     */
+    if(reass->processed_ip_in_len != reass->len) {
+      return;
+    }
+    sicslowpan_len = reass->len;
+    /* Free the context */
+    reass->len = 0;
   } else {
 #endif /* SICSLOWPAN_CONF_FRAG */
     sicslowpan_len = packetbuf_payload_len + uncomp_hdr_len;
 #if SICSLOWPAN_CONF_FRAG
   }
 
-  /*
-   * If we have a full IP packet in sicslowpan_buf, deliver it to
-   * the IP stack
-   */
-  PRINTF("sicslowpan_init processed_ip_in_len %d, sicslowpan_len %d\n",
-         processed_ip_in_len, sicslowpan_len);
-  if(processed_ip_in_len == 0 || (processed_ip_in_len == sicslowpan_len)) {
-    PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
-           sicslowpan_len);
+  PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
+         sicslowpan_len);
+  if(sicslowpan_buf != uip_buf) {
     memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
-    uip_len = sicslowpan_len;
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
+  }
+  uip_len = sicslowpan_len;
 #endif /* SICSLOWPAN_CONF_FRAG */
 
 #if DEBUG
-    {
-      uint16_t ndx;
-      PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
-      for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
-        uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
-        PRINTF("%02x", data);
-      }
-      PRINTF("\n");
+  {
+    uint16_t ndx;
+    PRINTF("after decompression %u:", SICSLOWPAN_IP_BUF->len[1]);
+    for (ndx = 0; ndx < SICSLOWPAN_IP_BUF->len[1] + 40; ndx++) {
+      uint8_t data = ((uint8_t *) (SICSLOWPAN_IP_BUF))[ndx];
+      PRINTF("%02x", data);
     }
+    PRINTF("\n");
+  }
 #endif
 
-    /* if callback is set then set attributes and call */
-    if(callback) {
-      set_packet_attrs();
-      callback->input_callback();
-    }
-
-    tcpip_input();
-#if SICSLOWPAN_CONF_FRAG
+  /* if callback is set then set attributes and call */
+  if(callback) {
+    set_packet_attrs();
+    callback->input_callback();
   }
-#endif /* SICSLOWPAN_CONF_FRAG */
+
+  tcpip_input();
 }
 /** @} */
 
@@ -67,11 +67,21 @@ create_ipfix_template(int id, int (*compute_number_records)())
   new_template -> next = NULL;
   new_template -> compute_number_records = compute_number_records;
   new_template -> n = 0;
+  new_template -> scope_n = 0;
   new_template -> element_head = NULL;
 
   return new_template;
 }
 /*---------------------------------------------------------------------------*/
+template_t *
+create_ipfix_options_template(int id, int (*compute_number_records)(), int scope_n)
+{
+  template_t *new_template = create_ipfix_template(id, compute_number_records);
+  new_template -> scope_n = scope_n;
+
+  return new_template;
+}
+/*---------------------------------------------------------------------------*/
 void
 add_element_to_template(template_t *template, information_element_t *element)
 {
@@ -131,6 +141,10 @@ int
 add_ipfix_records_or_template(uint8_t *ipfix_message, template_t *template, int offset, int type)
 {
   int length_data = IPFIX_SET_HEADER_LENGTH;
+  if(type == IPFIX_TEMPLATE && template -> scope_n > 0){
+    // Options template record header also carries the scope field count
+    length_data = length_data + 2;
+  }
 
   //Set data records
   int i = 0;
@@ -178,6 +192,11 @@ add_ipfix_records_or_template(uint8_t *ipfix_message, template_t *template, int
     uint8_t big_endian_count[2];
     convert_to_big_endian((uint8_t *)&(template -> n), big_endian_count, sizeof(uint16_t));
     memcpy(&ipfix_message[offset+2], big_endian_count, sizeof(uint16_t));
+    if(template -> scope_n > 0){
+      uint8_t big_endian_scope_count[2];
+      convert_to_big_endian((uint8_t *)&(template -> scope_n), big_endian_scope_count, sizeof(uint16_t));
+      memcpy(&ipfix_message[offset+4], big_endian_scope_count, sizeof(uint16_t));
+    }
   }
   else{
     uint8_t big_endian_length_data[2];
@@ -346,7 +365,10 @@ generate_ipfix_message(uint8_t *ipfix_message, ipfix_t *ipfix, int type)
   }
 
   if(type == IPFIX_TEMPLATE){
-    uint16_t template_id = 2;
+    uint16_t template_id = IPFIX_TEMPLATE_SET_ID;
+    if(ipfix -> template_head != NULL && ipfix -> template_head -> scope_n > 0){
+      template_id = IPFIX_OPTIONS_TEMPLATE_SET_ID;
+    }
     uint8_t big_endian_template_id[2];
     convert_to_big_endian((uint8_t *)&template_id, big_endian_template_id, 2);
     memcpy(&ipfix_message[IPFIX_HEADER_LENGTH], big_endian_template_id, sizeof(uint16_t));
@@ -17,14 +17,30 @@
 #define IPFIX_DOMAIN_ID node_id
 
 #define IPFIX_TEMPLATE_ID 256
+#define IPFIX_TEMPLATE_SET_ID 2
+#define IPFIX_OPTIONS_TEMPLATE_SET_ID 3
 
 #define IPFIX_HEADER_LENGTH 16
 #define TIPFIX_HEADER_LENGTH 3
 #define IPFIX_SET_HEADER_LENGTH 4
 
-#define MAX_IPFIX 3
-#define MAX_TEMPLATES 3
-#define MAX_INFORMATION_ELEMENTS 10
+/* ipflow uses 3 structures, 3 templates and 23 elements with
+ * aggregation; the defaults leave room for one more template. */
+#ifdef TIPFIX_CONF_MAX_IPFIX
+#define MAX_IPFIX TIPFIX_CONF_MAX_IPFIX
+#else
+#define MAX_IPFIX 4
+#endif
+#ifdef TIPFIX_CONF_MAX_TEMPLATES
+#define MAX_TEMPLATES TIPFIX_CONF_MAX_TEMPLATES
+#else
+#define MAX_TEMPLATES 4
+#endif
+#ifdef TIPFIX_CONF_MAX_INFORMATION_ELEMENTS
+#define MAX_INFORMATION_ELEMENTS TIPFIX_CONF_MAX_INFORMATION_ELEMENTS
+#else
+#define MAX_INFORMATION_ELEMENTS 32
+#endif
 
 #define IPFIX_TEMPLATE 1
 #define IPFIX_DATA 2
@@ -43,6 +59,7 @@ typedef struct template{
   uint16_t id;
   int (*compute_number_records)();
   int n;
+  int scope_n;             // options template: first scope_n elements are scope
   information_element_t *element_head;
 }template_t;
 
@@ -64,6 +81,7 @@ information_element_t *create_ipfix_information_element(uint16_t id, uint16_t si
 void free_information_element(information_element_t * element);
 
 template_t *create_ipfix_template(int id, int (*compute_number_records)());
+template_t *create_ipfix_options_template(int id, int (*compute_number_records)(), int scope_n);
 void add_element_to_template(template_t *template, information_element_t *element);
 void free_template(template_t *template);
 
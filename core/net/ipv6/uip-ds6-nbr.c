@@ -120,6 +120,9 @@ uip_ds6_nbr_rm(uip_ds6_nbr_t *nbr)
 #endif /* UIP_CONF_IPV6_QUEUE_PKT */
     NEIGHBOR_STATE_CHANGED(nbr);
     nbr_table_remove(ds6_neighbors, nbr);
+#if TCPIP_NEXTHOP_CACHE
+    tcpip_nexthop_cache_flush();
+#endif /* TCPIP_NEXTHOP_CACHE */
   }
   return;
 }
@@ -0,0 +1,244 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *    Longest-prefix-match trie for the routing table.
+ *
+ *    Every node holds a prefix. The children of a node hold longer
+ *    prefixes extending it, child[b] those whose next bit is b. Nodes
+ *    with a route carry it, the others only exist where two branches
+ *    split, so there are never more than 2 * UIP_DS6_ROUTE_NB - 1 nodes.
+ */
+
+#include "net/ipv6/uip-ds6-route-trie.h"
+#include "lib/memb.h"
+
+#include <string.h>
+
+#if UIP_DS6_ROUTE_TRIE
+
+struct trie_node {
+  struct trie_node *child[2];
+  uip_ds6_route_t *route;
+  uip_ipaddr_t prefix;
+  uint8_t length;
+};
+
+MEMB(trienodememb, struct trie_node, 2 * UIP_DS6_ROUTE_NB);
+static struct trie_node *root;
+/*---------------------------------------------------------------------------*/
+static uint8_t
+bit_at(const uip_ipaddr_t *addr, uint8_t i)
+{
+  return (addr->u8[i >> 3] >> (7 - (i & 7))) & 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Number of leading bits a and b have in common, at most max */
+static uint8_t
+common_length(const uip_ipaddr_t *a, const uip_ipaddr_t *b, uint8_t max)
+{
+  uint8_t i;
+  uint8_t diff;
+
+  for(i = 0; i < max; i += 8) {
+    diff = a->u8[i >> 3] ^ b->u8[i >> 3];
+    if(diff != 0) {
+      while((diff & 0x80) == 0) {
+        diff <<= 1;
+        i++;
+      }
+      return i < max ? i : max;
+    }
+  }
+  return max;
+}
+/*---------------------------------------------------------------------------*/
+static int
+prefix_match(const uip_ipaddr_t *addr, const struct trie_node *n)
+{
+  uint8_t bytes = n->length >> 3;
+  uint8_t bits = n->length & 7;
+
+  if(memcmp(addr, &n->prefix, bytes) != 0) {
+    return 0;
+  }
+  if(bits == 0) {
+    return 1;
+  }
+  return ((addr->u8[bytes] ^ n->prefix.u8[bytes]) & (0xff << (8 - bits))) == 0;
+}
+/*---------------------------------------------------------------------------*/
+static struct trie_node *
+new_node(const uip_ipaddr_t *prefix, uint8_t length, uip_ds6_route_t *route)
+{
+  struct trie_node *n;
+
+  n = memb_alloc(&trienodememb);
+  if(n != NULL) {
+    n->child[0] = n->child[1] = NULL;
+    n->route = route;
+    uip_ipaddr_copy(&n->prefix, prefix);
+    n->length = length;
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_route_trie_init(void)
+{
+  memb_init(&trienodememb);
+  root = NULL;
+}
+/*---------------------------------------------------------------------------*/
+uip_ds6_route_t *
+uip_ds6_route_trie_lookup(const uip_ipaddr_t *addr)
+{
+  struct trie_node *n;
+  uip_ds6_route_t *found;
+
+  found = NULL;
+  for(n = root; n != NULL && prefix_match(addr, n);) {
+    if(n->route != NULL) {
+      found = n->route;
+    }
+    if(n->length == 128) {
+      break;
+    }
+    n = n->child[bit_at(addr, n->length)];
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+int
+uip_ds6_route_trie_add(uip_ds6_route_t *route)
+{
+  struct trie_node **link;
+  struct trie_node *n;
+  struct trie_node *branch;
+  struct trie_node *leaf;
+  uint8_t length;
+  uint8_t common;
+
+  length = route->length > 128 ? 128 : route->length;
+
+  for(link = &root; *link != NULL; link = &n->child[bit_at(&route->ipaddr, n->length)]) {
+    n = *link;
+    common = common_length(&route->ipaddr, &n->prefix,
+                           length < n->length ? length : n->length);
+    if(common < n->length) {
+      if(common == length) {
+        /* The new prefix covers n: insert it above n */
+        leaf = new_node(&route->ipaddr, length, route);
+        if(leaf == NULL) {
+          return 0;
+        }
+        leaf->child[bit_at(&n->prefix, length)] = n;
+        *link = leaf;
+        return 1;
+      }
+      /* The prefixes split below n's parent: add a branch node there */
+      branch = new_node(&route->ipaddr, common, NULL);
+      leaf = new_node(&route->ipaddr, length, route);
+      if(branch == NULL || leaf == NULL) {
+        if(branch != NULL) {
+          memb_free(&trienodememb, branch);
+        }
+        if(leaf != NULL) {
+          memb_free(&trienodememb, leaf);
+        }
+        return 0;
+      }
+      branch->child[bit_at(&n->prefix, common)] = n;
+      branch->child[bit_at(&route->ipaddr, common)] = leaf;
+      *link = branch;
+      return 1;
+    }
+    if(n->length == length) {
+      n->route = route;
+      return 1;
+    }
+  }
+
+  *link = new_node(&route->ipaddr, length, route);
+  return *link != NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_ds6_route_trie_rm(uip_ds6_route_t *route)
+{
+  struct trie_node **link;
+  struct trie_node **parent_link;
+  struct trie_node *n;
+  struct trie_node *parent;
+  uint8_t length;
+
+  length = route->length > 128 ? 128 : route->length;
+
+  parent_link = NULL;
+  for(link = &root; *link != NULL; link = &n->child[bit_at(&route->ipaddr, n->length)]) {
+    n = *link;
+    if(n->length > length || !prefix_match(&route->ipaddr, n)) {
+      return;
+    }
+    if(n->length == length) {
+      break;
+    }
+    parent_link = link;
+  }
+  if(*link == NULL || n->route != route) {
+    return;
+  }
+
+  n->route = NULL;
+  if(n->child[0] != NULL && n->child[1] != NULL) {
+    /* Still needed as a branch node */
+    return;
+  }
+
+  /* Replace n by its only child, if any */
+  *link = n->child[0] != NULL ? n->child[0] : n->child[1];
+  memb_free(&trienodememb, n);
+
+  /* A branch node left with a single child is not needed either */
+  if(parent_link != NULL) {
+    parent = *parent_link;
+    if(parent->route == NULL &&
+       (parent->child[0] == NULL || parent->child[1] == NULL)) {
+      *parent_link = parent->child[0] != NULL ? parent->child[0] : parent->child[1];
+      memb_free(&trienodememb, parent);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* UIP_DS6_ROUTE_TRIE */
+/** @} */
@@ -44,6 +44,7 @@
 #include "lib/list.h"
 #include "lib/memb.h"
 #include "net/nbr-table.h"
+#include "net/ipv6/uip-ds6-route-trie.h"
 
 #include <string.h>
 
@@ -71,6 +72,10 @@ LIST(notificationlist);
 #endif
 
 static int num_routes = 0;
+#if UIP_DS6_ROUTE_TRIE
+/* Counts lookups, to stamp routes in LRU order */
+static uint32_t lookup_counter = 0;
+#endif /* UIP_DS6_ROUTE_TRIE */
 
 #undef DEBUG
 #define DEBUG DEBUG_NONE
@@ -148,6 +153,9 @@ uip_ds6_route_init(void)
 {
   memb_init(&routememb);
   list_init(routelist);
+#if UIP_DS6_ROUTE_TRIE
+  uip_ds6_route_trie_init();
+#endif
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 
@@ -202,18 +210,41 @@ uip_ds6_route_num_routes(void)
   return num_routes;
 }
 /*---------------------------------------------------------------------------*/
+void
+uip_ds6_route_touch(uip_ds6_route_t *route)
+{
+#if UIP_DS6_ROUTE_TRIE
+  route->last_lookup = ++lookup_counter;
+#else /* UIP_DS6_ROUTE_TRIE */
+  if(route != list_head(routelist)) {
+    /* We put the route at the start of the routeslist list. The list
+       is ordered by how recently we looked them up: the least recently
+       used route will be at the end of the list - for fast lookups
+       (assuming multiple packets to the same node). */
+
+    list_remove(routelist, route);
+    list_push(routelist, route);
+  }
+#endif /* UIP_DS6_ROUTE_TRIE */
+}
+/*---------------------------------------------------------------------------*/
 uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t *addr)
 {
-  uip_ds6_route_t *r;
   uip_ds6_route_t *found_route;
+#if !UIP_DS6_ROUTE_TRIE
+  uip_ds6_route_t *r;
   uint8_t longestmatch;
+#endif /* !UIP_DS6_ROUTE_TRIE */
 
   PRINTF("uip-ds6-route: Looking up route for ");
   PRINT6ADDR(addr);
   PRINTF("\n");
 
 
+#if UIP_DS6_ROUTE_TRIE
+  found_route = uip_ds6_route_trie_lookup(addr);
+#else /* UIP_DS6_ROUTE_TRIE */
   found_route = NULL;
   longestmatch = 0;
   for(r = uip_ds6_route_head();
@@ -229,6 +260,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
       }
     }
   }
+#endif /* UIP_DS6_ROUTE_TRIE */
 
   if(found_route != NULL) {
     PRINTF("uip-ds6-route: Found route: ");
@@ -240,14 +272,8 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     PRINTF("uip-ds6-route: No route found\n");
   }
 
-  if(found_route != NULL && found_route != list_head(routelist)) {
-    /* If we found a route, we put it at the start of the routeslist
-       list. The list is ordered by how recently we looked them up:
-       the least recently used route will be at the end of the
-       list - for fast lookups (assuming multiple packets to the same node). */
-
-    list_remove(routelist, found_route);
-    list_push(routelist, found_route);
+  if(found_route != NULL) {
+    uip_ds6_route_touch(found_route);
   }
 
   return found_route;
@@ -301,7 +327,18 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
          least recently used route is the first route on the list. */
       uip_ds6_route_t *oldest;
 
+#if UIP_DS6_ROUTE_TRIE
+      /* The list is not kept in lookup order, look at the stamps */
+      for(oldest = r = uip_ds6_route_head();
+          r != NULL;
+          r = uip_ds6_route_next(r)) {
+        if((int32_t)(r->last_lookup - oldest->last_lookup) < 0) {
+          oldest = r;
+        }
+      }
+#else /* UIP_DS6_ROUTE_TRIE */
       oldest = list_tail(routelist); /* uip_ds6_route_head(); */
+#endif /* UIP_DS6_ROUTE_TRIE */
       PRINTF("uip_ds6_route_add: dropping route to ");
       PRINT6ADDR(&oldest->ipaddr);
       PRINTF("\n");
@@ -372,6 +409,16 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
   uip_ipaddr_copy(&(r->ipaddr), ipaddr);
   r->length = length;
 
+#if UIP_DS6_ROUTE_TRIE
+  r->last_lookup = ++lookup_counter;
+  if(!uip_ds6_route_trie_add(r)) {
+    /* Cannot happen, the trie has room for every route */
+    PRINTF("uip_ds6_route_add: could not index route\n");
+    uip_ds6_route_rm(r);
+    return NULL;
+  }
+#endif /* UIP_DS6_ROUTE_TRIE */
+
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
 #endif
@@ -409,6 +456,9 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
 
     /* Remove the route from the route list */
     list_remove(routelist, route);
+#if UIP_DS6_ROUTE_TRIE
+    uip_ds6_route_trie_rm(route);
+#endif
 
     /* Find the corresponding neighbor_route and remove it. */
     for(neighbor_route = list_head(route->neighbor_routes->route_list);
@@ -238,6 +238,9 @@ uip_ds6_prefix_add(uip_ipaddr_t *ipaddr, uint8_t ipaddrlen,
     locprefix->isused = 1;
     uip_ipaddr_copy(&locprefix->ipaddr, ipaddr);
     locprefix->length = ipaddrlen;
+#if TCPIP_NEXTHOP_CACHE
+    tcpip_nexthop_cache_flush();
+#endif /* TCPIP_NEXTHOP_CACHE */
     locprefix->advertise = advertise;
     locprefix->l_a_reserved = flags;
     locprefix->vlifetime = vtime;
@@ -266,6 +269,9 @@ uip_ds6_prefix_add(uip_ipaddr_t *ipaddr, uint8_t ipaddrlen,
     locprefix->isused = 1;
     uip_ipaddr_copy(&locprefix->ipaddr, ipaddr);
     locprefix->length = ipaddrlen;
+#if TCPIP_NEXTHOP_CACHE
+    tcpip_nexthop_cache_flush();
+#endif /* TCPIP_NEXTHOP_CACHE */
     if(interval != 0) {
       stimer_set(&(locprefix->vlifetime), interval);
       locprefix->isinfinite = 0;
@@ -286,6 +292,9 @@ uip_ds6_prefix_rm(uip_ds6_prefix_t *prefix)
 {
   if(prefix != NULL) {
     prefix->isused = 0;
+#if TCPIP_NEXTHOP_CACHE
+    tcpip_nexthop_cache_flush();
+#endif /* TCPIP_NEXTHOP_CACHE */
   }
   return;
 }
@@ -45,7 +45,7 @@
 #include <string.h>
 #include "net/ipv6/uip-ds6.h"
 #include "net/ipv6/uip-icmp6.h"
-#include "net/ipv6/ipv6flow/ipflow.h"
+#include "net/ipv6/uip-packet-observer.h"
 #include "contiki-default-conf.h"
 
 #include <stdlib.h>
@@ -316,10 +316,7 @@ uip_icmp6_send(const uip_ipaddr_t *dest, int type, int code, int payload_len)
   UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
 
   uip_len = UIP_IPH_LEN + UIP_ICMPH_LEN + payload_len;
-  // IPFLOW
-  if (get_process_status() == 1){
-    update_flow_table(&UIP_IP_BUF->destipaddr, uip_len, 1);
-  }
+  UIP_PACKET_OBSERVE(UIP_PACKET_OBSERVER_EGRESS);
   tcpip_ipv6_output();
 }
 /*---------------------------------------------------------------------------*/
@@ -548,9 +548,9 @@ na_input(void)
     return;
     }*/
   if(uip_packetqueue_buflen(&nbr->packethandle) != 0) {
-    uip_len = uip_packetqueue_buflen(&nbr->packethandle);
-    memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-    uip_packetqueue_free(&nbr->packethandle);
+    /* Send the oldest queued packet, tcpip_ipv6_output() sends the
+       others after it */
+    uip_len = uip_packetqueue_dequeue(&nbr->packethandle, UIP_IP_BUF);
     return;
   }
   
@@ -1020,9 +1020,9 @@ ra_input(void)
     return;
     }*/
   if(nbr != NULL && uip_packetqueue_buflen(&nbr->packethandle) != 0) {
-    uip_len = uip_packetqueue_buflen(&nbr->packethandle);
-    memcpy(UIP_IP_BUF, uip_packetqueue_buf(&nbr->packethandle), uip_len);
-    uip_packetqueue_free(&nbr->packethandle);
+    /* Send the oldest queued packet, tcpip_ipv6_output() sends the
+       others after it */
+    uip_len = uip_packetqueue_dequeue(&nbr->packethandle, UIP_IP_BUF);
     return;
   }
 
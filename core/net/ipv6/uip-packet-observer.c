@@ -0,0 +1,171 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *    Packet observer chain of the IPv6 stack
+ */
+#include "net/ipv6/uip-packet-observer.h"
+#include "net/ip/uip.h"
+
+#include "lib/list.h"
+
+#include <string.h>
+
+#if UIP_PACKET_OBSERVERS
+
+#define UIP_IP_BUF                ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_EXT_HDR(offset)       ((struct uip_ext_hdr *)&uip_buf[UIP_LLH_LEN + (offset)])
+#define UIP_PORTS(offset)         ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + (offset)])
+
+LIST(observerlist);
+/*---------------------------------------------------------------------------*/
+void
+uip_packet_observer_add(struct uip_packet_observer *o,
+                        uip_packet_observer_callback c)
+{
+  if(o != NULL && c != NULL) {
+    o->callback = c;
+    list_add(observerlist, o);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_packet_observer_rm(struct uip_packet_observer *o)
+{
+  list_remove(observerlist, o);
+}
+/*---------------------------------------------------------------------------*/
+static void
+parse_packet(struct uip_packet_view *view)
+{
+  uint16_t offset;
+  uint8_t next;
+
+  view->srcipaddr = &UIP_IP_BUF->srcipaddr;
+  view->destipaddr = &UIP_IP_BUF->destipaddr;
+  view->len = uip_len;
+  view->srcport = 0;
+  view->destport = 0;
+  view->link_len = 0;
+  view->link_hdr_len = 0;
+  view->fragments = 0;
+  view->link_dst = NULL;
+  view->mac_status = 0;
+  view->mac_transmissions = 0;
+
+  /* Skip extension headers to find the upper-layer protocol */
+  offset = UIP_IPH_LEN;
+  next = UIP_IP_BUF->proto;
+  while(offset + sizeof(struct uip_ext_hdr) <= uip_len) {
+    if(next == UIP_PROTO_HBHO || next == UIP_PROTO_DESTO ||
+       next == UIP_PROTO_ROUTING) {
+      next = UIP_EXT_HDR(offset)->next;
+      offset += (UIP_EXT_HDR(offset)->len << 3) + 8;
+    } else if(next == UIP_PROTO_FRAG) {
+      next = UIP_EXT_HDR(offset)->next;
+      offset += UIP_FRAGH_LEN;
+    } else {
+      break;
+    }
+  }
+  view->proto = next;
+
+  if((next == UIP_PROTO_UDP || next == UIP_PROTO_TCP) &&
+     offset + sizeof(struct uip_udp_hdr) <= uip_len) {
+    view->srcport = UIP_HTONS(UIP_PORTS(offset)->srcport);
+    view->destport = UIP_HTONS(UIP_PORTS(offset)->destport);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+call_observers(int tap, struct uip_packet_view *view)
+{
+  struct uip_packet_observer *o;
+  for(o = list_head(observerlist); o != NULL; o = list_item_next(o)) {
+    o->callback(tap, view);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_packet_observer_call(int tap)
+{
+  struct uip_packet_view view;
+
+  if(list_head(observerlist) == NULL) {
+    return;
+  }
+
+  parse_packet(&view);
+  call_observers(tap, &view);
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_packet_observer_link_call(uint16_t link_len, uint8_t link_hdr_len,
+                              uint8_t fragments, const uip_lladdr_t *link_dst)
+{
+  struct uip_packet_view view;
+
+  if(list_head(observerlist) == NULL) {
+    return;
+  }
+
+  parse_packet(&view);
+  view.link_len = link_len;
+  view.link_hdr_len = link_hdr_len;
+  view.fragments = fragments;
+  view.link_dst = link_dst;
+  call_observers(UIP_PACKET_OBSERVER_LINK, &view);
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_packet_observer_mac_call(const uip_ipaddr_t *srcipaddr,
+                             const uip_ipaddr_t *destipaddr,
+                             int status, int transmissions)
+{
+  struct uip_packet_view view;
+
+  if(list_head(observerlist) == NULL) {
+    return;
+  }
+
+  /* uip_buf no longer holds the packet, only addresses are known */
+  memset(&view, 0, sizeof(view));
+  view.srcipaddr = srcipaddr;
+  view.destipaddr = destipaddr;
+  view.mac_status = status;
+  view.mac_transmissions = transmissions;
+  call_observers(UIP_PACKET_OBSERVER_MAC, &view);
+}
+/*---------------------------------------------------------------------------*/
+#endif /* UIP_PACKET_OBSERVERS */
+/** @} */
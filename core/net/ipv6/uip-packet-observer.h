@@ -0,0 +1,112 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \addtogroup uip6
+ * @{
+ */
+
+/**
+ * \file
+ *    Packet observers: callbacks invoked by the IPv6 stack for every
+ *    received, sent or forwarded packet, used by traffic meters such
+ *    as ipflow.
+ */
+
+#ifndef UIP_PACKET_OBSERVER_H_
+#define UIP_PACKET_OBSERVER_H_
+
+#include "net/ip/uip.h"
+
+/* Off by default, the taps then cost nothing. ipflow needs them on. */
+#ifndef UIP_CONF_PACKET_OBSERVERS
+#define UIP_PACKET_OBSERVERS 0
+#else
+#define UIP_PACKET_OBSERVERS UIP_CONF_PACKET_OBSERVERS
+#endif
+
+/* Taps where observers are called. INGRESS sees packets delivered to this
+   node, EGRESS packets sent by this node and FORWARD packets routed
+   through it. LINK is called by the link layer once a packet, sent or
+   forwarded, has been handed to the MAC, with its on-air size. MAC is
+   called for every frame of a packet once the MAC layer is done with it,
+   with only the addresses and the transmission outcome set. */
+#define UIP_PACKET_OBSERVER_INGRESS 0
+#define UIP_PACKET_OBSERVER_EGRESS  1
+#define UIP_PACKET_OBSERVER_FORWARD 2
+#define UIP_PACKET_OBSERVER_LINK    3
+#define UIP_PACKET_OBSERVER_MAC     4
+
+/** \brief Header fields of the packet in uip_buf, parsed once per tap */
+struct uip_packet_view {
+  const uip_ipaddr_t *srcipaddr;
+  const uip_ipaddr_t *destipaddr;
+  uint16_t len;      /* IPv6 packet length, header included */
+  uint16_t srcport;  /* TCP/UDP ports in host byte order, 0 otherwise */
+  uint16_t destport;
+  uint8_t proto;     /* upper-layer protocol, after extension headers */
+  /* Only set on the LINK tap */
+  uint16_t link_len;     /* bytes on air, MAC and security overhead included */
+  uint8_t link_hdr_len;  /* compressed IPv6 header length */
+  uint8_t fragments;     /* number of fragments, 0 if not fragmented */
+  const uip_lladdr_t *link_dst; /* next hop, null address for broadcast */
+  /* Only set on the MAC tap */
+  uint8_t mac_status;        /* MAC_TX_ status of the frame */
+  uint8_t mac_transmissions; /* transmission attempts of the frame */
+};
+
+typedef void (* uip_packet_observer_callback)(int tap,
+                                              const struct uip_packet_view *view);
+struct uip_packet_observer {
+  struct uip_packet_observer *next;
+  uip_packet_observer_callback callback;
+};
+
+#if UIP_PACKET_OBSERVERS
+void uip_packet_observer_add(struct uip_packet_observer *o,
+                             uip_packet_observer_callback c);
+void uip_packet_observer_rm(struct uip_packet_observer *o);
+void uip_packet_observer_call(int tap);
+void uip_packet_observer_link_call(uint16_t link_len, uint8_t link_hdr_len,
+                                   uint8_t fragments,
+                                   const uip_lladdr_t *link_dst);
+void uip_packet_observer_mac_call(const uip_ipaddr_t *srcipaddr,
+                                  const uip_ipaddr_t *destipaddr,
+                                  int status, int transmissions);
+
+#define UIP_PACKET_OBSERVE(tap) uip_packet_observer_call(tap)
+#define UIP_PACKET_OBSERVE_LINK(len, hdr_len, fragments, dst) \
+  uip_packet_observer_link_call(len, hdr_len, fragments, dst)
+#else /* UIP_PACKET_OBSERVERS */
+#define uip_packet_observer_add(o, c)
+#define uip_packet_observer_rm(o)
+#define UIP_PACKET_OBSERVE(tap)
+#define UIP_PACKET_OBSERVE_LINK(len, hdr_len, fragments, dst)
+#endif /* UIP_PACKET_OBSERVERS */
+
+#endif /* UIP_PACKET_OBSERVER_H_ */
+/** @} */
@@ -74,11 +74,12 @@
 #include "sys/cc.h"
 #include "net/ip/uip.h"
 #include "net/ip/uipopt.h"
+#include "net/ip/uip-chksum.h"
 #include "net/ipv6/uip-icmp6.h"
 #include "net/ipv6/uip-nd6.h"
 #include "net/ipv6/uip-ds6.h"
 #include "net/ipv6/multicast/uip-mcast6.h"
-#include "net/ipv6/ipv6flow/ipflow.h"
+#include "net/ipv6/uip-packet-observer.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -322,41 +323,10 @@ uip_add32(uint8_t *op32, uint16_t op16)
 
 #if ! UIP_ARCH_CHKSUM
 /*---------------------------------------------------------------------------*/
-static uint16_t
-chksum(uint16_t sum, const uint8_t *data, uint16_t len)
-{
-  uint16_t t;
-  const uint8_t *dataptr;
-  const uint8_t *last_byte;
-
-  dataptr = data;
-  last_byte = data + len - 1;
-
-  while(dataptr < last_byte) {   /* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
-    }
-    dataptr += 2;
-  }
-
-  if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
-    }
-  }
-
-  /* Return sum in host byte order. */
-  return sum;
-}
-/*---------------------------------------------------------------------------*/
 uint16_t
 uip_chksum(uint16_t *data, uint16_t len)
 {
-  return uip_htons(chksum(0, (uint8_t *)data, len));
+  return uip_htons(uip_chksum_add(0, (uint8_t *)data, len));
 }
 /*---------------------------------------------------------------------------*/
 #ifndef UIP_ARCH_IPCHKSUM
@@ -365,7 +335,7 @@ uip_ipchksum(void)
 {
   uint16_t sum;
 
-  sum = chksum(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
+  sum = uip_chksum_add(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
   PRINTF("uip_ipchksum: sum 0x%04x\n", sum);
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
@@ -395,11 +365,11 @@ upper_layer_chksum(uint8_t proto)
   /* IP protocol and length fields. This addition cannot carry. */
   sum = upper_layer_len + proto;
   /* Sum IP source and destination addresses. */
-  sum = chksum(sum, (uint8_t *)&UIP_IP_BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
+  sum = uip_chksum_add(sum, (uint8_t *)&UIP_IP_BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
 
   /* Sum TCP header and data. */
-  sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN + uip_ext_len],
-               upper_layer_len);
+  sum = uip_chksum_add(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN + uip_ext_len],
+                       upper_layer_len);
 
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
@@ -1240,6 +1210,7 @@ uip_process(uint8_t flag)
       PRINT6ADDR(&UIP_IP_BUF->destipaddr);
       PRINTF("\n");
       UIP_STAT(++uip_stat.ip.forwarded);
+      UIP_PACKET_OBSERVE(UIP_PACKET_OBSERVER_FORWARD);
       goto send;
     } else {
       if((uip_is_addr_link_local(&UIP_IP_BUF->srcipaddr)) &&
@@ -1279,6 +1250,8 @@ uip_process(uint8_t flag)
   process:
 #endif
 
+  UIP_PACKET_OBSERVE(UIP_PACKET_OBSERVER_INGRESS);
+
   while(1) {
     switch(*uip_next_hdr){
 #if UIP_TCP
@@ -1585,10 +1558,7 @@ uip_process(uint8_t flag)
   rpl_insert_header();
 #endif /* UIP_CONF_IPV6_RPL */
 
-// IPFLOW
-if (get_process_status() == 1){
-  update_flow_table(&UIP_IP_BUF->destipaddr, uip_len, 1);
-}
+  UIP_PACKET_OBSERVE(UIP_PACKET_OBSERVER_EGRESS);
   UIP_STAT(++uip_stat.udp.sent);
   goto ip_send_nolen;
 #endif /* UIP_UDP */
@@ -2297,10 +2267,7 @@ if (get_process_status() == 1){
   /* Calculate TCP checksum. */
   UIP_TCP_BUF->tcpchksum = 0;
   UIP_TCP_BUF->tcpchksum = ~(uip_tcpchksum());
-  // IPFLOW
-  if (get_process_status() == 1){
-    update_flow_table(&UIP_IP_BUF->destipaddr, uip_len, 1);
-  }
+  UIP_PACKET_OBSERVE(UIP_PACKET_OBSERVER_EGRESS);
   UIP_STAT(++uip_stat.tcp.sent);
 
 #endif /* UIP_TCP */
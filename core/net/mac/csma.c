@@ -47,6 +47,7 @@
 #include "lib/random.h"
 
 #include "net/netstack.h"
+#include "net/traffic-hints.h"
 
 #include "lib/list.h"
 #include "lib/memb.h"
@@ -115,6 +116,24 @@ struct neighbor_queue {
 #define CSMA_MAX_PACKET_PER_NEIGHBOR MAX_QUEUED_PACKETS
 #endif /* CSMA_CONF_MAX_PACKET_PER_NEIGHBOR */
 
+/*
+ * Traffic hints: share the packet pool between neighbor queues in
+ * proportion to the traffic measured towards each neighbor, so a busy
+ * next hop gets a longer queue. Every neighbor keeps room for at least
+ * CSMA_MIN_PACKET_PER_NEIGHBOR packets.
+ */
+#ifdef CSMA_CONF_TRAFFIC_HINTS
+#define CSMA_TRAFFIC_HINTS CSMA_CONF_TRAFFIC_HINTS
+#else
+#define CSMA_TRAFFIC_HINTS 0
+#endif /* CSMA_CONF_TRAFFIC_HINTS */
+
+#ifdef CSMA_CONF_MIN_PACKET_PER_NEIGHBOR
+#define CSMA_MIN_PACKET_PER_NEIGHBOR CSMA_CONF_MIN_PACKET_PER_NEIGHBOR
+#else
+#define CSMA_MIN_PACKET_PER_NEIGHBOR 2
+#endif /* CSMA_CONF_MIN_PACKET_PER_NEIGHBOR */
+
 #define MAX_QUEUED_PACKETS QUEUEBUF_NUM
 MEMB(neighbor_memb, struct neighbor_queue, CSMA_MAX_NEIGHBOR_QUEUES);
 MEMB(packet_memb, struct rdc_buf_list, MAX_QUEUED_PACKETS);
@@ -313,6 +332,26 @@ packet_sent(void *ptr, int status, int num_transmissions)
   }
 }
 /*---------------------------------------------------------------------------*/
+static int
+queue_limit(const linkaddr_t *addr)
+{
+#if CSMA_TRAFFIC_HINTS
+  uint32_t total = traffic_hints_total_rate();
+  int limit;
+
+  if(total > 0) {
+    limit = (uint32_t)MAX_QUEUED_PACKETS * traffic_hints_rate(addr) / total;
+    if(limit < CSMA_MIN_PACKET_PER_NEIGHBOR) {
+      limit = CSMA_MIN_PACKET_PER_NEIGHBOR;
+    }
+    if(limit < CSMA_MAX_PACKET_PER_NEIGHBOR) {
+      return limit;
+    }
+  }
+#endif /* CSMA_TRAFFIC_HINTS */
+  return CSMA_MAX_PACKET_PER_NEIGHBOR;
+}
+/*---------------------------------------------------------------------------*/
 static void
 send_packet(mac_callback_t sent, void *ptr)
 {
@@ -355,7 +394,7 @@ send_packet(mac_callback_t sent, void *ptr)
 
   if(n != NULL) {
     /* Add packet to the neighbor's queue */
-    if(list_length(n->queued_packet_list) < CSMA_MAX_PACKET_PER_NEIGHBOR) {
+    if(list_length(n->queued_packet_list) < queue_limit(addr)) {
       q = memb_alloc(&packet_memb);
       if(q != NULL) {
         q->ptr = memb_alloc(&metadata_memb);
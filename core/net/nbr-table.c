@@ -62,6 +62,13 @@ static unsigned num_tables;
 MEMB(neighbor_addr_mem, nbr_table_key_t, NBR_TABLE_MAX_NEIGHBORS);
 LIST(nbr_table_keys);
 
+#if NBR_TABLE_WITH_HASH
+/* Chained hash index of the keys. Entries hold a neighbor index plus one,
+ * so that zero ends a chain and the tables need no initialization */
+static uint16_t hash_heads[NBR_TABLE_HASH_BUCKETS];
+static uint16_t hash_next[NBR_TABLE_MAX_NEIGHBORS];
+#endif /* NBR_TABLE_WITH_HASH */
+
 /*---------------------------------------------------------------------------*/
 /* Get a key from a neighbor index */
 static nbr_table_key_t *
@@ -105,16 +112,67 @@ key_from_item(nbr_table_t *table, const nbr_table_item_t *item)
   return key_from_index(index_from_item(table, item));
 }
 /*---------------------------------------------------------------------------*/
+#if NBR_TABLE_WITH_HASH
+/* Get the hash bucket of a link-layer address */
+static unsigned
+hash_lladdr(const linkaddr_t *lladdr)
+{
+  unsigned h = 0;
+  int i;
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    h = h * 31 + lladdr->u8[i];
+  }
+  return h & (NBR_TABLE_HASH_BUCKETS - 1);
+}
+/*---------------------------------------------------------------------------*/
+/* Add a key to the hash index */
+static void
+hash_add(nbr_table_key_t *key)
+{
+  int index = index_from_key(key);
+  unsigned bucket = hash_lladdr(&key->lladdr);
+  hash_next[index] = hash_heads[bucket];
+  hash_heads[bucket] = index + 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a key from the hash index */
+static void
+hash_remove(nbr_table_key_t *key)
+{
+  int index = index_from_key(key);
+  uint16_t *link = &hash_heads[hash_lladdr(&key->lladdr)];
+  while(*link != 0) {
+    if(*link == index + 1) {
+      *link = hash_next[index];
+      return;
+    }
+    link = &hash_next[*link - 1];
+  }
+}
+#endif /* NBR_TABLE_WITH_HASH */
+/*---------------------------------------------------------------------------*/
 /* Get the index of a neighbor from its link-layer address */
 static int
 index_from_lladdr(const linkaddr_t *lladdr)
 {
   nbr_table_key_t *key;
+#if NBR_TABLE_WITH_HASH
+  uint16_t entry;
+#endif /* NBR_TABLE_WITH_HASH */
   /* Allow lladdr-free insertion, useful e.g. for IPv6 ND.
    * Only one such entry is possible at a time, indexed by linkaddr_null. */
   if(lladdr == NULL) {
     lladdr = &linkaddr_null;
   }
+#if NBR_TABLE_WITH_HASH
+  for(entry = hash_heads[hash_lladdr(lladdr)]; entry != 0;
+      entry = hash_next[entry - 1]) {
+    key = key_from_index(entry - 1);
+    if(linkaddr_cmp(lladdr, &key->lladdr)) {
+      return entry - 1;
+    }
+  }
+#else /* NBR_TABLE_WITH_HASH */
   key = list_head(nbr_table_keys);
   while(key != NULL) {
     if(lladdr && linkaddr_cmp(lladdr, &key->lladdr)) {
@@ -122,6 +180,7 @@ index_from_lladdr(const linkaddr_t *lladdr)
     }
     key = list_item_next(key);
   }
+#endif /* NBR_TABLE_WITH_HASH */
   return -1;
 }
 /*---------------------------------------------------------------------------*/
@@ -218,6 +277,9 @@ nbr_table_allocate(void)
       used_map[index_from_key(least_used_key)] = 0;
       /* Remove neighbor from list */
       list_remove(nbr_table_keys, least_used_key);
+#if NBR_TABLE_WITH_HASH
+      hash_remove(least_used_key);
+#endif /* NBR_TABLE_WITH_HASH */
       /* Return associated key */
       return least_used_key;
     }
@@ -298,6 +360,9 @@ nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr)
 
     /* Set link-layer address */
     linkaddr_copy(&key->lladdr, lladdr);
+#if NBR_TABLE_WITH_HASH
+    hash_add(key);
+#endif /* NBR_TABLE_WITH_HASH */
   }
 
   /* Get item in the current table */
@@ -46,6 +46,21 @@
 #define NBR_TABLE_MAX_NEIGHBORS 8
 #endif /* NBR_TABLE_CONF_MAX_NEIGHBORS */
 
+/* Index neighbors by a hash of their link-layer address, so that lookups
+ * do not walk all neighbors. Worth it for large NBR_TABLE_MAX_NEIGHBORS */
+#ifdef NBR_TABLE_CONF_WITH_HASH
+#define NBR_TABLE_WITH_HASH NBR_TABLE_CONF_WITH_HASH
+#else /* NBR_TABLE_CONF_WITH_HASH */
+#define NBR_TABLE_WITH_HASH 0
+#endif /* NBR_TABLE_CONF_WITH_HASH */
+
+/* Number of hash buckets, a power of two */
+#ifdef NBR_TABLE_CONF_HASH_BUCKETS
+#define NBR_TABLE_HASH_BUCKETS NBR_TABLE_CONF_HASH_BUCKETS
+#else /* NBR_TABLE_CONF_HASH_BUCKETS */
+#define NBR_TABLE_HASH_BUCKETS 16
+#endif /* NBR_TABLE_CONF_HASH_BUCKETS */
+
 /* An item in a neighbor table */
 typedef void nbr_table_item_t;
 
@@ -48,6 +48,7 @@
 
 #include "net/rpl/rpl-private.h"
 #include "net/nbr-table.h"
+#include "net/traffic-hints.h"
 
 #define DEBUG DEBUG_NONE
 #include "net/ip/uip-debug.h"
@@ -85,6 +86,29 @@ rpl_of_t rpl_mrhof = {
  */
 #define PARENT_SWITCH_THRESHOLD_DIV	2
 
+/*
+ * Traffic hints: when comparing parents, add up to
+ * RPL_MRHOF_TRAFFIC_MAX_PENALTY to the path metric of a parent in
+ * proportion to the traffic we already send through it, reaching the
+ * maximum at RPL_MRHOF_TRAFFIC_CAPACITY bytes per second. The penalty
+ * stays below the switch threshold so that it only tips the balance
+ * between comparable parents, and is not advertised to children.
+ */
+#ifdef RPL_MRHOF_CONF_TRAFFIC_HINTS
+#define RPL_MRHOF_TRAFFIC_HINTS RPL_MRHOF_CONF_TRAFFIC_HINTS
+#else
+#define RPL_MRHOF_TRAFFIC_HINTS 0
+#endif /* RPL_MRHOF_CONF_TRAFFIC_HINTS */
+
+#ifdef RPL_MRHOF_CONF_TRAFFIC_CAPACITY
+#define RPL_MRHOF_TRAFFIC_CAPACITY RPL_MRHOF_CONF_TRAFFIC_CAPACITY
+#else
+#define RPL_MRHOF_TRAFFIC_CAPACITY 2000
+#endif /* RPL_MRHOF_CONF_TRAFFIC_CAPACITY */
+
+#define RPL_MRHOF_TRAFFIC_MAX_PENALTY \
+  (RPL_DAG_MC_ETX_DIVISOR / (2 * PARENT_SWITCH_THRESHOLD_DIV))
+
 typedef uint16_t rpl_path_metric_t;
 
 static rpl_path_metric_t
@@ -111,6 +135,20 @@ calculate_path_metric(rpl_parent_t *p)
 #endif /* RPL_DAG_MC */
 }
 
+#if RPL_MRHOF_TRAFFIC_HINTS
+static rpl_path_metric_t
+traffic_penalty(rpl_parent_t *p)
+{
+  uint32_t rate;
+
+  rate = traffic_hints_rate(nbr_table_get_lladdr(rpl_parents, p));
+  if(rate >= RPL_MRHOF_TRAFFIC_CAPACITY) {
+    return RPL_MRHOF_TRAFFIC_MAX_PENALTY;
+  }
+  return rate * RPL_MRHOF_TRAFFIC_MAX_PENALTY / RPL_MRHOF_TRAFFIC_CAPACITY;
+}
+#endif /* RPL_MRHOF_TRAFFIC_HINTS */
+
 static void
 reset(rpl_dag_t *dag)
 {
@@ -219,6 +257,10 @@ best_parent(rpl_parent_t *p1, rpl_parent_t *p2)
 
   p1_metric = calculate_path_metric(p1);
   p2_metric = calculate_path_metric(p2);
+#if RPL_MRHOF_TRAFFIC_HINTS
+  p1_metric += traffic_penalty(p1);
+  p2_metric += traffic_penalty(p2);
+#endif /* RPL_MRHOF_TRAFFIC_HINTS */
 
   /* Maintain stability of the preferred parent in case of similar ranks. */
   if(p1 == dag->preferred_parent || p2 == dag->preferred_parent) {
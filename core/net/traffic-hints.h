@@ -0,0 +1,53 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *    Traffic hints: measured per-neighbor traffic rates, provided by a
+ *    local traffic meter (such as ipflow) and used by lower layers to
+ *    balance load, e.g. RPL parent selection and CSMA queue sizing.
+ *    Without a provider every rate is 0 and users behave as before.
+ */
+
+#ifndef TRAFFIC_HINTS_H_
+#define TRAFFIC_HINTS_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+struct traffic_hints_provider {
+  /* Bytes per second recently sent to this next-hop neighbor */
+  uint32_t (* rate)(const linkaddr_t *nexthop);
+  /* Bytes per second recently sent to all neighbors */
+  uint32_t (* total_rate)(void);
+};
+
+void traffic_hints_register(const struct traffic_hints_provider *provider);
+uint32_t traffic_hints_rate(const linkaddr_t *nexthop);
+uint32_t traffic_hints_total_rate(void);
+
+#endif /* TRAFFIC_HINTS_H_ */
@@ -352,6 +352,9 @@ PROCESS_THREAD(border_router_process, ev, data)
   SENSORS_ACTIVATE(button_sensor);
 
   launch_ipflow(AGGRESSIVE, GATEWAY);
+#if IPFLOW_WITH_TCP
+  set_export_transport(IPFLOW_TRANSPORT_TCP);
+#endif
 
   PRINTF("RPL-Border router started\n");
 #if 0
@@ -31,6 +31,9 @@
 #ifndef PROJECT_ROUTER_CONF_H_
 #define PROJECT_ROUTER_CONF_H_
 
+/* ipflow meters packets through the packet observer taps */
+#define UIP_CONF_PACKET_OBSERVERS 1
+
 #ifndef UIP_FALLBACK_INTERFACE
 #define UIP_FALLBACK_INTERFACE rpl_interface
 #endif
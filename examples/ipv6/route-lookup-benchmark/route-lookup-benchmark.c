@@ -0,0 +1,148 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+
+/**
+ * \file
+ *    Measures uip_ds6_route_lookup() against a linear scan of the
+ *    route list for growing numbers of downward routes, as a storing
+ *    mode RPL root would hold them. Run on the native platform.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "lib/random.h"
+
+#include <stdio.h>
+
+#define LOOKUPS 100000
+
+static const int sizes[] = { 100, 1000, 10000 };
+
+static uip_ipaddr_t nexthop;
+static uip_lladdr_t nexthop_ll;
+/*---------------------------------------------------------------------------*/
+PROCESS(route_lookup_benchmark_process, "Route lookup benchmark");
+AUTOSTART_PROCESSES(&route_lookup_benchmark_process);
+/*---------------------------------------------------------------------------*/
+/* Address of the i-th node. Every 16th node gets its /64 routed
+   instead of a host route, so lookups mix both lengths. Those /64s
+   are taken from fd01::/16: a /64 covering host routes with the same
+   next hop would make uip_ds6_route_add() skip the host routes. */
+static int
+route_length(int i)
+{
+  return (i & 15) == 0 ? 64 : 128;
+}
+static void
+route_addr(uip_ipaddr_t *addr, int i)
+{
+  uip_ip6addr(addr, route_length(i) == 64 ? 0xfd01 : 0xfd00,
+              0, 0, i >> 4, 0, 0, 0, i & 0xffff);
+}
+/*---------------------------------------------------------------------------*/
+/* The lookup as done before the trie, as the baseline */
+static uip_ds6_route_t *
+linear_lookup(uip_ipaddr_t *addr)
+{
+  uip_ds6_route_t *r;
+  uip_ds6_route_t *found_route;
+  uint8_t longestmatch;
+
+  found_route = NULL;
+  longestmatch = 0;
+  for(r = uip_ds6_route_head(); r != NULL; r = uip_ds6_route_next(r)) {
+    if(r->length >= longestmatch &&
+       uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
+      longestmatch = r->length;
+      found_route = r;
+      if(longestmatch == 128) {
+        break;
+      }
+    }
+  }
+  return found_route;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long
+run(int n, uip_ds6_route_t *(*lookup)(uip_ipaddr_t *), int *misses)
+{
+  uip_ipaddr_t addr;
+  clock_time_t start;
+  long i;
+
+  *misses = 0;
+  start = clock_time();
+  for(i = 0; i < LOOKUPS; i++) {
+    route_addr(&addr, random_rand() % n);
+    if(lookup(&addr) == NULL) {
+      (*misses)++;
+    }
+  }
+  /* ns per lookup */
+  return (unsigned long)((clock_time() - start) * (1000000000UL / CLOCK_SECOND) / LOOKUPS);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(route_lookup_benchmark_process, ev, data)
+{
+  static int s;
+  uip_ipaddr_t addr;
+  int i;
+  int misses;
+  unsigned long trie_ns;
+  unsigned long linear_ns;
+
+  PROCESS_BEGIN();
+
+  uip_ip6addr(&nexthop, 0xfe80, 0, 0, 0, 0, 0, 0, 1);
+  nexthop_ll.addr[sizeof(nexthop_ll.addr) - 1] = 1;
+  if(uip_ds6_nbr_add(&nexthop, &nexthop_ll, 1, NBR_REACHABLE) == NULL) {
+    printf("Could not add the next hop\n");
+    PROCESS_EXIT();
+  }
+
+  printf("routes trie(ns) linear(ns) misses\n");
+  i = 0;
+  for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for(; i < sizes[s]; i++) {
+      route_addr(&addr, i);
+      uip_ds6_route_add(&addr, route_length(i), &nexthop);
+    }
+    if(uip_ds6_route_num_routes() != sizes[s]) {
+      printf("Only %d of %d routes added, check UIP_CONF_MAX_ROUTES\n",
+             uip_ds6_route_num_routes(), sizes[s]);
+      PROCESS_EXIT();
+    }
+    trie_ns = run(sizes[s], uip_ds6_route_lookup, &misses);
+    linear_ns = run(sizes[s], linear_lookup, &misses);
+    printf("%d %lu %lu %d\n", uip_ds6_route_num_routes(),
+           trie_ns, linear_ns, misses);
+    PROCESS_PAUSE();
+  }
+
+  PROCESS_END();
+}